@@ -1,25 +1,38 @@
 #include "authenticator.h"
+#include "handshake_executor.h"
 #include "statics.h"
 #include "errors.h"
-
-#include <mbedtls/sha256.h>
+#include "sha256_fixed.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 
 namespace puf {
 
 
+static uint32_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint32_t>(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+
+
 Authenticator::Authenticator(Network &net, AuthenticationServer &as) : 
     net(net), 
     as(as), 
-    G(PUFStatics::instance().ecp_group().G),
-    connected_(false)
+    batching(false),
+    executor(NULL)
 { }
 
 Authenticator::~Authenticator() {
-    as.sync();
+    try {
+        as.sync();
+    } catch(const Exception &e) {
+        puts(e.what());
+    }
 }
 
 void Authenticator::init() {
@@ -31,6 +44,7 @@ void Authenticator::init() {
 
 int Authenticator::sign_up() {
     REGISTER reg;
+    MAC base_mac, remote_mac;
 
     uint8_t buffer[128];
     size_t n = net.receive(buffer, sizeof(buffer));
@@ -41,72 +55,274 @@ int Authenticator::sign_up() {
         return 1;
     }
 
-    A = reg.T;
     base_mac = reg.src_mac;                 // Store Base MAC
     remote_mac = reg.src_mac;               // Current remote MAC (differs from base MAC when hashed)
     switch_mac = reg.dst_mac;               // Current MAC of this very device
     printf("Remote MAC:\t"); remote_mac.print();
     remote_mac.hash(1);                     // Hash
-    printf("Public Key A: "); A.print64();
+    printf("Public Key A: "); reg.T.print64();
 
-    as.store(base_mac, A, remote_mac, DEFAULT_COUNTER);
+    as.store(base_mac, reg.T, remote_mac, DEFAULT_COUNTER);
 
     return 0;
 }
 
 
-int Authenticator::PUF_CON_phase() {
-    // Query for hashed mac
-    auto q = as.query(puf_con.src_mac);
-    if(!q) {
-        return 1;
+HandshakeEvent Authenticator::on_PUF_CON(uint8_t *buffer, size_t n) {
+    HandshakeEvent ev = {HS_REJECTED_E, {}};
+    PUF_CON puf_con;
+    PUF_SYN puf_syn;
+    Session s;
+
+    try {
+        puf_con.from_binary( buffer, n );
+    } catch(const Exception &e) {           // Faulty package or invalid point T
+        puts(e.what());
+        return ev;
     }
-    base_mac = q.mac;
-    A = q.ecp;
-    remote_mac = puf_con.src_mac;
-    return 0;
+    ev.remote_mac = puf_con.src_mac;
+
+    // Query supplicant and calculate PUF_SYN before anything changes. The source MAC
+    // is sent in clear, so a session and flow of it stay until the handshake is verified.
+    s.remote_mac = puf_con.src_mac;
+    if( PUF_CON_phase(s, puf_con, as) != 0 ||
+        PUF_SYN_phase(s, switch_mac, PUFStatics::instance(), puf_syn) != 0 ) {
+        return ev;
+    }
+    if( sessions.emplace(s, now_ms()) == NULL ) {
+        puts("Session table is full");
+        return ev;
+    }
+    net.send(puf_syn.binary(), puf_syn.header_len());
+
+    ev.type = HS_SYN_SENT_E;
+    return ev;
+}
+
+
+bool Authenticator::open_flow(Session &s) {
+    // The handshake is verified, only now may the server move on along the MAC chain
+    as.advance(s.remote_mac);
+
+    // Data frames are validated against the chain table only. The new chain replaces
+    // the one of an earlier handshake, a device has one flow, the one of its latest identity
+    if( chains.insert(s.remote_mac, chain_key(s), &s.base_mac, now_ms()) == NULL ) {
+        puts("Chain table is full");
+        return false;
+    }
+    s.pending = false;
+    s.connected = true;
+    return true;
 }
 
 
-int Authenticator::PUF_SYN_phase() {
-    puf_syn.pc = base_mac;              // Set PUF Challenge
-    puf_syn.dst_mac = remote_mac;       // Set remote MAC
-    puf_syn.src_mac = switch_mac;       // Set source MAC
-    mbedtls_mpi_sint d_sint = rand();   // Get random number
-    puf_syn.d = d_sint;                 // Set random value for d
-    c = rand();                         // Set random value for c
+HandshakeEvent Authenticator::on_PUF_SYN_ACK(uint8_t *buffer, size_t n) {
+    HandshakeEvent ev = {HS_IGNORED_E, {}};
+    PUF_SYN_ACK puf_syn_ack;
+    Session *s;
 
     try {
-        puf_syn.C = G*c;                    // Calc C
-        K = puf_con.T*c;                    // Calc K (required for k = K.x)
-#if MBEDTLS_VERSION_MAJOR >= 3
-        k = K.private_X;                    // Calc k
-        puf_syn.pc ^= k.private_p;          // Calc pc
-#else 
-        k = K.X;                            // Calc k
-        puf_syn.pc ^= k.p;                  // Calc pc
-#endif
-    } catch(const MathException &e) {
+        puf_syn_ack.from_binary( buffer, n );
+    } catch(const Exception &e) {           // Faulty package or invalid point S
         puts(e.what());
-        return 1;
+        return ev;
     }
 
-    puf_syn.calc();                     // Build package
-    net.send(puf_syn.binary(), puf_syn.header_len());
+    // Route PUF_SYN_ACK to the session of its sender
+    if( (s = sessions.find(puf_syn_ack.src_mac)) == NULL || !s->pending || s->verifying ) {
+        puts("PUF_SYN_ACK without pending handshake");
+        return ev;
+    }
+    ev.remote_mac = puf_syn_ack.src_mac;
+
+    // Defer verification to the next batch
+    if(batching) {
+        if( !batch.push(puf_syn_ack.S, s->d, s->A, s->T, s->A_table) ) {
+            sessions.reject(puf_syn_ack.src_mac);
+            ev.type = HS_REJECTED_E;
+            return ev;
+        }
+        queued.push_back( {s->remote_mac, s->opened_ms} );
+        s->verifying = true;
+        ev.type = HS_QUEUED_E;
+        return ev;
+    }
 
-    return 0;
+    // Check if access is granted
+    if( !PUF_ACK_phase(*s, puf_syn_ack) || !open_flow(*s) ) {
+        sessions.reject(puf_syn_ack.src_mac);
+        ev.type = HS_REJECTED_E;
+        return ev;
+    }
+
+    ev.type = HS_CONNECTED_E;
+    return ev;
+}
+
+
+HandshakeEvent Authenticator::handle(uint8_t *buffer, size_t n) {
+    HandshakeEvent ev = {HS_IGNORED_E, {}};
+
+    if( buffer == NULL || n <= sizeof(MAC)*2+2 ) {
+        return ev;
+    }
+
+    const packet_type_e type = deduce_type(buffer, n);
+    if( executor != NULL && (type == PUF_CON_E || type == PUF_SYN_ACK_E) ) {
+        memcpy(ev.remote_mac.bytes, buffer + sizeof(MAC), sizeof(MAC));
+
+        // The flow stays until poll() replaces it with the one of the verified handshake
+        if( executor->dispatch(buffer, n) ) {
+            ev.type = HS_DISPATCHED_E;
+        }
+        return ev;
+    }
+
+    switch(type) {
+        case PUF_CON_E:
+            return on_PUF_CON(buffer, n);
+        case PUF_SYN_ACK_E:
+            return on_PUF_SYN_ACK(buffer, n);
+        default:
+            return ev;
+    }
+}
+
+
+/**
+ * @return True if no frame has been validated against the chain since the handshake
+*/
+static bool chain_fresh(const ChainState &c) {
+    for(size_t i=0; i<sizeof(c.hk_mac); ++i) {
+        if(c.hk_mac[i] != 0) return false;
+    }
+    return true;
+}
+
+
+uint64_t Authenticator::handle_burst(const Frame *frames, size_t n, std::vector<HandshakeEvent> &events) {
+    MAC src_mac[VALIDATE_BATCH_MAX];
+    uint32_t payload[VALIDATE_BATCH_MAX];
+    bool initial_frame[VALIDATE_BATCH_MAX];
+    size_t index[VALIDATE_BATCH_MAX];
+    PUF_PerformanceView pv;
+    uint64_t valid = 0, mask;
+    size_t i, j, m = 0;
+
+    if( n > VALIDATE_BATCH_MAX ) {
+        n = VALIDATE_BATCH_MAX;
+    }
+
+    for(i=0; i<=n; ++i) {
+        const bool data = i < n && frames[i].buf != NULL && frames[i].len > sizeof(MAC)*2+2 &&
+                          deduce_type(frames[i].buf, frames[i].len) == PUF_PERFORMANCE_E;
+
+        // Collect data frames, the first frame of a fresh chain starts it
+        if( data ) {
+            if( !PUF_PerformanceView::check(frames[i].buf, frames[i].len) ) continue;
+            pv.from_binary(frames[i].buf, frames[i].len);
+            src_mac[m] = pv.src_mac();
+            payload[m] = pv.get_payload().payload;
+
+            ChainState *c = chains.find(src_mac[m]);
+            initial_frame[m] = c != NULL && chain_fresh(*c);
+            for(j=0; j<m && initial_frame[m]; ++j) {
+                initial_frame[m] = !(src_mac[j] == src_mac[m]);
+            }
+            index[m++] = i;
+            continue;
+        }
+
+        // Validate collected data frames before a handshake may change their chains
+        if( m > 0 ) {
+            mask = validate_chains(src_mac, payload, initial_frame, m);
+            for(j=0; j<m; ++j) {
+                valid |= ((mask >> j) & 1) << index[j];
+            }
+            m = 0;
+        }
+
+        if( i < n ) {
+            HandshakeEvent ev = handle(frames[i].buf, frames[i].len);
+            if( ev.type != HS_IGNORED_E ) {
+                events.push_back(ev);
+            }
+        }
+    }
+
+    if( executor != NULL ) {
+        executor->poll(chains, events);
+    }
+
+    return valid;
+}
+
+
+size_t Authenticator::expire() {
+    size_t n = sessions.expire(now_ms(), NETWORK_TIMEOUT_MS, &chains);
+    if( executor != NULL ) {
+        n += executor->expire(chains);
+    }
+    return n;
 }
 
 
-bool Authenticator::PUF_ACK_phase() {
-    S = A*puf_syn.d + puf_con.T;                    // Calculate S
-    return puf_syn_ack.S == S;
+void Authenticator::offload(HandshakeExecutor *executor) {
+    this->executor = executor;
+}
+
+
+size_t Authenticator::batch_verification(bool enable, std::vector<HandshakeEvent> &events) {
+    size_t n = 0;
+
+    // Resolve what is queued before switching
+    if(!enable) {
+        n = verify_queued(events, true);
+    }
+    batching = enable;
+    return n;
+}
+
+
+size_t Authenticator::verify_queued(std::vector<HandshakeEvent> &events, bool force) {
+    std::vector<bool> ok;
+    size_t n = resolved.size();
+
+    events.insert(events.end(), resolved.begin(), resolved.end());
+    resolved.clear();
+
+    if( batch.size() == 0 || (!force && !batch.due()) ) {
+        return n;
+    }
+
+    batch.verify(ok);
+
+    for(size_t i=0; i<queued.size(); ++i) {
+        Session *s = sessions.find(queued[i].remote_mac);
+
+        // Session expired or restarted while being queued
+        if( s == NULL || !s->verifying || s->opened_ms != queued[i].opened_ms ) {
+            continue;
+        }
+
+        HandshakeEvent ev = {HS_CONNECTED_E, queued[i].remote_mac};
+        s->verifying = false;
+        if( !ok[i] || !open_flow(*s) ) {
+            sessions.reject(queued[i].remote_mac);
+            ev.type = HS_REJECTED_E;
+        }
+        events.push_back(ev);
+        n++;
+    }
+
+    queued.clear();
+    return n;
 }
 
 
 int Authenticator::accept(uint8_t *buffer, size_t n) {    
     uint8_t buffer_[128];
-    uint8_t n_;
+    int n_;
 
     // Error check
     if( deduce_type(buffer, n) != PUF_CON_E ) {
@@ -114,67 +330,195 @@ int Authenticator::accept(uint8_t *buffer, size_t n) {
         return 1;
     }
 
-    // Query supplicant
-    puf_con.from_binary( buffer, n );
-    if( PUF_CON_phase() != 0) {
-        puts("Query did not yield result");
+    HandshakeEvent ev = handle(buffer, n);
+    if( ev.type != HS_SYN_SENT_E ) {
         return 1;
     }
-    connected_ = false;
-
-    // Calculate and send PUF_SYN
-    PUF_SYN_phase();
-
-    // Receive PUF_SYN_ACK
-    n_ = net.receive(buffer_, sizeof(buffer_));
-    if( deduce_type(buffer_, n_) != PUF_SYN_ACK_E ) {
-        puts("Packet is not of type PUF_SYN_ACK");
-        return 1;
+    const MAC remote_mac = ev.remote_mac;
+
+    // Drive the handshake engine until this handshake is resolved. Frames of
+    // other supplicants are processed on the way.
+    while( (n_ = net.receive(buffer_, sizeof(buffer_))) > 0 ) {
+        ev = handle(buffer_, n_);
+        expire();
+
+        // Do not wait for a batch to fill up
+        if( ev.type == HS_QUEUED_E && ev.remote_mac == remote_mac ) {
+            std::vector<HandshakeEvent> events;
+            int result = 1;
+            verify_queued(events, true);
+
+            // The events of other supplicants are handed out by the next verify_queued()
+            for(const HandshakeEvent &e : events) {
+                if( !(e.remote_mac == remote_mac) ) {
+                    resolved.push_back(e);
+                } else if( e.type == HS_CONNECTED_E ) {
+                    result = 0;
+                }
+            }
+            return result;
+        }
+
+        if( (ev.type == HS_CONNECTED_E || ev.type == HS_REJECTED_E) && ev.remote_mac == remote_mac ) {
+            return ev.type == HS_CONNECTED_E ? 0 : 1;
+        }
+        const Session *s = sessions.find(remote_mac);
+        if( s == NULL || !s->pending ) {
+            puts("Handshake timed out");
+            return 1;
+        }
     }
 
-    // Check if access is granted
-    puf_syn_ack.from_binary(buffer_, n_);
-    connected_ = PUF_ACK_phase();
-    return connected_ ? 0 : 1;
+    puts("Timeout");
+    return 1;
 }
 
 
-bool Authenticator::validate(const PUF_Performance &pp, bool initial_frame) {
-
-    static uint8_t serv_hk_mac[32];
-    static uint8_t concat_buf[36];
-    static VLAN_Payload p;
+bool Authenticator::connected(const MAC &remote_mac) {
+    if( executor != NULL ) {
+        return executor->connected(remote_mac);
+    }
+    Session *s = sessions.find(remote_mac);
+    return s != NULL && s->connected;
+}
 
-    // Check if connected and correct MAC
-    if( !connected() ) return false;
-    if( memcmp(pp.src_mac.bytes, remote_mac.bytes, sizeof(MAC) ) != 0 ) return false;
 
+/**
+ * Builds the input of the next hash of the chain: the source MAC on the initial
+ * frame or the last hash otherwise, followed by 4 bytes of k and zero padding
+*/
+static void chain_input(const ChainState &c, const MAC &src_mac, bool initial_frame, uint8_t *buf) {
     size_t k_offset = 0;
 
+    memset( buf, 0, SHA256_CHAIN_LEN );
     if(initial_frame) {
         k_offset = sizeof(MAC);
-        memcpy( concat_buf, pp.src_mac.bytes, k_offset );
+        memcpy( buf, src_mac.bytes, k_offset );
     } else {
-        k_offset = sizeof(serv_hk_mac);
-        memcpy( concat_buf, serv_hk_mac, k_offset );
+        k_offset = sizeof(c.hk_mac);
+        memcpy( buf, c.hk_mac, k_offset );
     }
 
     // Concatenate 4 digits of k to concatenation buffer
-#if MBEDTLS_VERSION_MAJOR >= 3
-    memcpy( concat_buf+k_offset, k.private_p, 4 );
-    if( mbedtls_sha256(concat_buf, sizeof(concat_buf), serv_hk_mac, 0) != 0) {
-#else
-    memcpy( concat_buf+k_offset, k.p, 4 );
-    if( mbedtls_sha256_ret(concat_buf, sizeof(concat_buf), serv_hk_mac, 0) != 0) {
-#endif
-        puts("Error calculating SHA256\n");
+    memcpy( buf+k_offset, c.k, sizeof(c.k) );
+}
+
+
+/**
+ * @return The VLAN tags carrying a hash of the chain
+*/
+static uint32_t chain_payload(const uint8_t *hk_mac) {
+    VLAN_Payload p;
+    p.load1 = *(reinterpret_cast<const uint16_t*>(hk_mac));
+    p.load2 = *(reinterpret_cast<const uint16_t*>(hk_mac+30));
+    return p.payload;
+}
+
+
+bool Authenticator::validate_chain(const MAC &src_mac, uint32_t payload, bool initial_frame) {
+
+    uint8_t concat_buf[SHA256_CHAIN_LEN];
+
+    // Check if the sender is connected
+    ChainState *c = chains.find(src_mac);
+    if( c == NULL ) return false;
+
+    chain_input(*c, src_mac, initial_frame, concat_buf);
+    sha256_chain(concat_buf, c->hk_mac);
+
+    if( chain_payload(c->hk_mac) != payload ) {
         return false;
     }
+    c->seen_ms = now_ms();
+    return true;
+}
 
-    p.load1 = *(reinterpret_cast<uint16_t*>(serv_hk_mac));
-    p.load2 = *(reinterpret_cast<uint16_t*>(serv_hk_mac+30));
 
-    return p.payload == pp.get_payload().payload;
+uint64_t Authenticator::validate_chains(const MAC src_mac[], const uint32_t payload[], const bool initial_frame[], size_t n) {
+    uint8_t in[VALIDATE_BATCH_MAX * SHA256_CHAIN_LEN];
+    uint8_t out[VALIDATE_BATCH_MAX * 32];
+    ChainState *c[VALIDATE_BATCH_MAX];
+    size_t frame[VALIDATE_BATCH_MAX];
+    uint64_t todo = 0, valid = 0;
+    size_t i, l, lanes;
+    const uint32_t now = now_ms();
+
+    // Check if the senders are connected
+    for(i=0; i<n; ++i) {
+        c[i] = chains.find(src_mac[i]);
+        if( c[i] != NULL ) {
+            todo |= static_cast<uint64_t>(1) << i;
+        }
+    }
+
+    // Every round hashes the next frame of each supplicant, frames of the same
+    // supplicant depend on each other
+    while(todo != 0) {
+        lanes = 0;
+        for(i=0; i<n; ++i) {
+            if( ((todo >> i) & 1) == 0 ) continue;
+
+            for(l=0; l<lanes && c[frame[l]] != c[i]; ++l);
+            if(l < lanes) continue;
+
+            chain_input(*c[i], src_mac[i], initial_frame != NULL && initial_frame[i], in + lanes*SHA256_CHAIN_LEN);
+            frame[lanes++] = i;
+        }
+
+        sha256_chain_many(in, out, lanes);
+
+        for(l=0; l<lanes; ++l) {
+            i = frame[l];
+            memcpy(c[i]->hk_mac, out + l*32, sizeof(c[i]->hk_mac));
+            if( chain_payload(c[i]->hk_mac) == payload[i] ) {
+                c[i]->seen_ms = now;
+                valid |= static_cast<uint64_t>(1) << i;
+            }
+            todo &= ~(static_cast<uint64_t>(1) << i);
+        }
+    }
+
+    return valid;
+}
+
+
+bool Authenticator::validate(const PUF_Performance &pp, bool initial_frame) {
+    return validate_chain(pp.src_mac, pp.get_payload().payload, initial_frame);
+}
+
+
+bool Authenticator::validate(const PUF_PerformanceView &pv, bool initial_frame) {
+    return validate_chain(pv.src_mac(), pv.get_payload().payload, initial_frame);
+}
+
+
+uint64_t Authenticator::validate(const PUF_Performance *const pp[], const bool initial_frame[], size_t n) {
+    MAC src_mac[VALIDATE_BATCH_MAX];
+    uint32_t payload[VALIDATE_BATCH_MAX];
+
+    if( n > VALIDATE_BATCH_MAX ) {
+        n = VALIDATE_BATCH_MAX;
+    }
+    for(size_t i=0; i<n; ++i) {
+        src_mac[i] = pp[i]->src_mac;
+        payload[i] = pp[i]->get_payload().payload;
+    }
+    return validate_chains(src_mac, payload, initial_frame, n);
+}
+
+
+uint64_t Authenticator::validate(const PUF_PerformanceView pv[], const bool initial_frame[], size_t n) {
+    MAC src_mac[VALIDATE_BATCH_MAX];
+    uint32_t payload[VALIDATE_BATCH_MAX];
+
+    if( n > VALIDATE_BATCH_MAX ) {
+        n = VALIDATE_BATCH_MAX;
+    }
+    for(size_t i=0; i<n; ++i) {
+        src_mac[i] = pv[i].src_mac();
+        payload[i] = pv[i].get_payload().payload;
+    }
+    return validate_chains(src_mac, payload, initial_frame, n);
 }
 
 
@@ -2,35 +2,63 @@
 
 #include "packets.h"
 #include "platform.h"
+#include "session.h"
+#include "chain_table.h"
+#include "batch_verifier.h"
 #include "math.h"
 
 namespace puf {
 
 
+enum handshake_event_e {
+    HS_IGNORED_E = 0x00,        // Frame is not part of a handshake
+    HS_SYN_SENT_E = 0x01,       // PUF_CON accepted, PUF_SYN sent
+    HS_CONNECTED_E = 0x02,      // PUF_SYN_ACK verified, access granted
+    HS_REJECTED_E = 0x03,       // Handshake failed, session removed
+    HS_QUEUED_E = 0x04,         // PUF_SYN_ACK queued for batch verification
+    HS_DISPATCHED_E = 0x05      // Frame handed to a HandshakeExecutor
+};
+
+
+typedef struct HandshakeEvent {
+    handshake_event_e type;
+    MAC remote_mac;
+} HandshakeEvent;
+
+
+class HandshakeExecutor;
+
+
 class Authenticator {
 public:
 
     Network &net;
     AuthenticationServer &as;
 
-    MPI k;
-    MPI c;
-    ECP_Point G;
-    ECP_Point A;
-    ECP_Point K;
-    ECP_Point S;
-
-    MAC base_mac; 
-    MAC remote_mac;
     MAC switch_mac;
 
-    PUF_CON puf_con;
-    PUF_SYN puf_syn;
-    PUF_SYN_ACK puf_syn_ack;
+    SessionTable sessions;
+    ChainTable chains;
+
+    typedef struct Queued {
+        MAC remote_mac;
+        uint32_t opened_ms;
+    } Queued;
+
+    bool batching;
+    BatchVerifier batch;
+    std::vector<Queued> queued;
+    std::vector<HandshakeEvent> resolved;   // Events of queued handshakes resolved by accept()
 
-    int PUF_CON_phase();
-    int PUF_SYN_phase();
-    bool PUF_ACK_phase();
+    HandshakeExecutor *executor;
+
+    bool open_flow(Session&);
+
+    bool validate_chain(const MAC &src_mac, uint32_t payload, bool initial_frame);
+    uint64_t validate_chains(const MAC src_mac[], const uint32_t payload[], const bool initial_frame[], size_t n);
+
+    HandshakeEvent on_PUF_CON(uint8_t *buffer, size_t n);
+    HandshakeEvent on_PUF_SYN_ACK(uint8_t *buffer, size_t n);
 
 public:
     Authenticator(Network&, AuthenticationServer&);
@@ -42,12 +70,90 @@ public:
     void init();
     int sign_up();
     int accept(uint8_t *buffer, size_t n);
-    bool connected() {return connected_;}
+    HandshakeEvent handle(uint8_t *buffer, size_t n);
+
+    /**
+     * Processes a burst of received frames, e.g. from Network::receive_batch().
+     * Handshake frames are handled as by handle(), data frames are validated
+     * together as by the batched validate(). The first data frame of a supplicant
+     * after its handshake is taken as the initial frame of its hash chain.
+     * @param frames The frames, at most VALIDATE_BATCH_MAX
+     * @param n Number of frames
+     * @param events Receives the events of the handshake frames that were not ignored
+     * @return Bit i is set if frame i is a valid data frame
+    */
+    uint64_t handle_burst(const Frame *frames, size_t n, std::vector<HandshakeEvent> &events);
+
+    /**
+     * Removes sessions whose handshake has not completed within NETWORK_TIMEOUT_MS,
+     * and connected sessions together with their flows once these have seen no valid
+     * data frame for SESSION_IDLE_MS or have ended. Must not run concurrently with
+     * validate().
+     * @return Number of removed sessions
+    */
+    size_t expire();
+
+    /**
+     * Enables batch verification. handle() then queues PUF_SYN_ACKs, which are
+     * verified by verify_queued(). Disabling verifies what is queued.
+     * @param enable Queue PUF_SYN_ACKs from now on
+     * @param events Receives the events of the handshakes that were still queued
+     * @return Number of appended events
+    */
+    size_t batch_verification(bool enable, std::vector<HandshakeEvent> &events);
+
+    /**
+     * Verifies queued PUF_SYN_ACKs once the batch is due. Should be called
+     * after every handle() and when the network is idle.
+     * @param events Receives a HS_CONNECTED_E or HS_REJECTED_E per queued handshake,
+     *               including those of other supplicants resolved by accept()
+     * @param force Verify even if the batch is not due
+     * @return Number of appended events
+    */
+    size_t verify_queued(std::vector<HandshakeEvent> &events, bool force = false);
+
+    /**
+     * Hands the handshake frames of handle() and handle_burst() to an executor,
+     * which must be started. handle() then returns HS_DISPATCHED_E, and
+     * handle_burst() also appends the events of finished handshakes and opens
+     * their flows. accept() and batch verification do not apply.
+     * @param executor The executor, NULL to handle handshakes inline again
+    */
+    void offload(HandshakeExecutor *executor);
+    bool connected(const MAC &remote_mac);
+
+    /**
+     * Checks the VLAN tags of a data frame against the hash chain of its sender.
+     * May run concurrently with itself for frames of different senders, but not with
+     * handshakes, which change the table, see ChainTable.
+     * @param pp The frame
+     * @param initial_frame The frame starts a new hash chain
+     * @return True if the frame is valid
+    */
     bool validate(const PUF_Performance &pp, bool initial_frame=false);
 
-private:
-    bool connected_;
+    /**
+     * As validate() above, reading the frame in place
+    */
+    bool validate(const PUF_PerformanceView &pv, bool initial_frame=false);
+
+    /**
+     * Validates data frames of many supplicants at once, hashing several hash
+     * chains in parallel. Frames of the same supplicant are checked in order.
+     * May run concurrently for disjoint sets of senders, but not with handshakes,
+     * see ChainTable.
+     * @param pp The frames
+     * @param initial_frame Per frame flag as in validate(), NULL if no frame is initial
+     * @param n Number of frames, at most VALIDATE_BATCH_MAX
+     * @return Bit i is set if frame i is valid
+    */
+    uint64_t validate(const PUF_Performance *const pp[], const bool initial_frame[], size_t n);
+
+    /**
+     * As the batched validate() above, reading the frames in place
+    */
+    uint64_t validate(const PUF_PerformanceView pv[], const bool initial_frame[], size_t n);
 };
 
 
-};
\ No newline at end of file
+};
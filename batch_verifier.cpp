@@ -0,0 +1,180 @@
+#include "batch_verifier.h"
+#include "statics.h"
+#include "ecp_arith.h"
+#include "errors.h"
+
+#include <time.h>
+
+
+namespace puf {
+
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+BatchVerifier::BatchVerifier(size_t max_batch, uint32_t max_latency_us, size_t min_batch) :
+    max_batch(max_batch > 0 ? max_batch : 1),
+    min_batch(min_batch > 2 ? min_batch : 2),
+    max_latency_us(max_latency_us),
+    first_us(0),
+    us_batch(0.0),
+    us_single(0.0),
+    fail_rate(0.0)
+{
+    items.reserve(this->max_batch);
+}
+
+
+bool BatchVerifier::push(const ECP_Point &S, const MPI &d, const ECP_Point &A, const ECP_Point &T,
+                         const std::shared_ptr<FixedBase> &A_table) {
+    // The batch equation only holds in the prime order group
+    if( mbedtls_ecp_check_pubkey(&PUFStatics::instance().ecp_group(), &S) != 0 ) {
+        return false;
+    }
+
+    if( items.empty() ) {
+        first_us = now_us();
+    }
+
+    items.emplace_back();
+    Item &item = items.back();
+    item.S = S;
+    item.A = A;
+    item.T = T;
+    item.d = d;
+    item.A_table = A_table;
+    return true;
+}
+
+
+bool BatchVerifier::batch_pays() const {
+    // Measure both costs once before comparing them
+    if( us_batch <= 0.0 || us_single <= 0.0 ) {
+        return us_batch <= 0.0;
+    }
+
+    // A failed batch is paid for on top of the single checks
+    return us_batch + fail_rate * us_single < us_single;
+}
+
+
+double BatchVerifier::us_per_item() const {
+    if( batch_pays() && us_batch > 0.0 ) {
+        return us_batch + fail_rate * us_single;
+    }
+    return us_single > 0.0 ? us_single : us_batch;
+}
+
+
+size_t BatchVerifier::target() const {
+    const double cost = us_per_item();
+    if( cost <= 0.0 ) {
+        return max_batch;
+    }
+
+    const double n = max_latency_us / cost;
+    return n < 1.0 ? 1 : n > max_batch ? max_batch : static_cast<size_t>(n);
+}
+
+
+bool BatchVerifier::due() const {
+    if( items.empty() ) {
+        return false;
+    }
+    if( items.size() >= target() ) {
+        return true;
+    }
+
+    // Waited time plus the time the batch will take
+    const double expected_us = (now_us() - first_us) + us_per_item() * items.size();
+    return expected_us >= max_latency_us;
+}
+
+
+bool BatchVerifier::check(size_t begin, size_t end) {
+    ECP_Arith &arith = PUFStatics::instance().ecp_arith();
+    mbedtls_ctr_drbg_context &drbg = PUFStatics::instance().ctr_drbg_context();
+    const size_t n = end - begin;
+    ECP_PointVec D(n + 1);
+    std::vector<mbedtls_ecp_point*> Dp(n);
+    std::vector<MPI> e(2*n);
+    std::vector<const mbedtls_mpi*> m(2*n);
+    std::vector<const mbedtls_ecp_point*> P(2*n);
+    mbedtls_ecp_point *R = &D[n];
+
+    // D_i = T_i - S_i, all made affine with one inversion
+    for(size_t i=0; i<n; ++i) {
+        const Item &item = items[begin + i];
+        arith.neg(R, &item.S);
+        arith.add(&D[i], &item.T, R);
+        Dp[i] = &D[i];
+    }
+    arith.normalize_many(Dp.data(), n);
+
+    // sum z_i d_i A_i + z_i D_i
+    for(size_t i=0; i<n; ++i) {
+        MPI &z = e[2*i+1];
+        MATH_CHK( mbedtls_mpi_fill_random(&z, BATCH_VERIFY_BITS/8, mbedtls_ctr_drbg_random, &drbg) );
+        MATH_CHK( mbedtls_mpi_set_bit(&z, 0, 1) );
+        e[2*i] = z * items[begin + i].d;
+
+        m[2*i] = &e[2*i];
+        P[2*i] = &items[begin + i].A;
+        m[2*i+1] = &e[2*i+1];
+        P[2*i+1] = &D[i];
+    }
+
+    arith.msm_vartime(R, m.data(), P.data(), 2*n);
+    return mbedtls_mpi_cmp_int(ECP_Z(R), 0) == 0;
+}
+
+
+void BatchVerifier::verify(std::vector<bool> &ok) {
+    const size_t n = items.size();
+    uint64_t start = now_us();
+    bool passed = false, failed = false;
+
+    ok.assign(n, false);
+    if( n == 0 ) {
+        return;
+    }
+
+    try {
+        if( n >= min_batch && batch_pays() ) {
+            passed = check(0, n);
+            const double cost = static_cast<double>(now_us() - start) / n;
+            us_batch = us_batch <= 0.0 ? cost : 0.8 * us_batch + 0.2 * cost;
+            if(passed) {
+                ok.assign(n, true);
+            }
+            failed = !passed;
+            start = now_us();
+        }
+
+        // Bisecting a failed batch costs more than checking its equations one by one
+        if( !passed ) {
+            for(size_t i=0; i<n; ++i) {
+                const Item &item = items[i];
+                ok[i] = verify_muladd(item.S, item.d, item.A, item.T, item.A_table.get());
+                failed |= !ok[i];
+            }
+            const double cost = static_cast<double>(now_us() - start) / n;
+            us_single = us_single <= 0.0 ? cost : 0.8 * us_single + 0.2 * cost;
+        }
+    } catch(const MathException &e) {
+        puts(e.what());
+        ok.assign(n, false);
+        failed = true;
+    }
+    items.clear();
+
+    // Single checks tell as well whether the batch would have failed
+    fail_rate = 0.8 * fail_rate + 0.2 * (failed ? 1.0 : 0.0);
+}
+
+
+};  // namespace puf
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "math.h"
+#include "fixed_base.h"
+#include "global_defines.h"
+
+namespace puf {
+
+
+/**
+ * Verifies many S == d*A + T equations at once. A batch is accepted if the
+ * random linear combination sum z_i (d_i A_i + T_i - S_i) is the point at
+ * infinity, which a batch with a false equation passes with probability
+ * 2^-BATCH_VERIFY_BITS. The equations of a failed batch are checked one by one.
+ *
+ * The batch equation is cheaper than single checks only from min_batch equations
+ * on, and a failed batch costs the batch and all single checks on top. So smaller
+ * batches are checked one by one, and so are all batches while the measured rate
+ * of failing batches makes the batch dearer than single checks, e.g. while forged
+ * PUF_SYN_ACKs arrive. The target batch size adapts to the expected cost per
+ * equation so that queued equations wait no longer than the latency budget.
+*/
+class BatchVerifier {
+private:
+    typedef struct Item {
+        ECP_Point S, A, T;
+        MPI d;
+        std::shared_ptr<FixedBase> A_table;
+    } Item;
+
+    std::vector<Item> items;
+    size_t max_batch;
+    size_t min_batch;
+    uint32_t max_latency_us;
+    uint64_t first_us;
+    double us_batch;                // Moving average of the cost of one equation in a batch
+    double us_single;               // Moving average of the cost of one single check
+    double fail_rate;               // Moving average of the share of batches with a false equation
+
+    bool batch_pays() const;
+    double us_per_item() const;
+    bool check(size_t begin, size_t end);
+
+public:
+    /**
+     * @param max_batch Upper bound of the batch size
+     * @param max_latency_us Latency budget of a queued equation in us
+     * @param min_batch Smallest batch checked with the batch equation
+    */
+    BatchVerifier(size_t max_batch = BATCH_VERIFY_MAX, uint32_t max_latency_us = BATCH_VERIFY_LATENCY_US,
+                  size_t min_batch = BATCH_VERIFY_MIN);
+
+    /**
+     * Queues S == d*A + T
+     * @param A_table Precomputed table of A for the single check, may be NULL
+     * @return False if S is not a valid point, the equation is not queued then
+    */
+    bool push(const ECP_Point &S, const MPI &d, const ECP_Point &A, const ECP_Point &T,
+              const std::shared_ptr<FixedBase> &A_table = nullptr);
+
+    /**
+     * @return True if the batch is full or its oldest equation would exceed the
+     * latency budget when waiting any longer
+    */
+    bool due() const;
+
+    /**
+     * Verifies and removes all queued equations
+     * @param ok Result of each equation in the order of push()
+    */
+    void verify(std::vector<bool> &ok);
+
+    size_t size() const {return items.size();}
+    size_t target() const;
+};
+
+
+};  // namespace puf
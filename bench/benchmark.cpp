@@ -0,0 +1,534 @@
+/**
+ * Micro benchmarks of the protocol math on Linux.
+ *
+ * Build from the repository root, e.g.
+ *   g++ -O2 -std=c++17 -pthread -I. *.cpp bench/benchmark.cpp -lmbedcrypto -o puf_bench
+ * and compare the numbers between revisions.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+#include <thread>
+
+#include <mbedtls/sha256.h>
+
+#include "packets.h"
+#include "statics.h"
+#include "batch_verifier.h"
+#include "sha256_fixed.h"
+#include "chain_table.h"
+#include "mac_chain.h"
+#include "mapped_server.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#else
+#define CYCLES() 0ULL
+#endif
+
+using namespace puf;
+
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void report(const char *name, int iterations, uint64_t ns, uint64_t cycles) {
+    printf("%-40s %10.1f us/op %14llu cycles/op\n", name, ns / 1000.0 / iterations,
+        static_cast<unsigned long long>(cycles / iterations));
+}
+
+
+static void report_ns(const char *name, int iterations, uint64_t ns, uint64_t cycles) {
+    printf("%-40s %10.1f ns/op %14llu cycles/op\n", name, static_cast<double>(ns) / iterations,
+        static_cast<unsigned long long>(cycles / iterations));
+}
+
+
+/* Everything but the network I/O of a handshake, both sides */
+typedef struct Handshake {
+    ECP_Point G;
+    MPI a;
+    ECP_Point A;
+    uint8_t con_frame[128];
+    uint8_t syn_frame[128];
+    uint8_t ack_frame[128];
+
+    Handshake() : G(PUFStatics::instance().ecp_group().G), a(0x5a5a5a5a5a5aLL) {
+        A = G*a;
+    }
+
+    // Supplicant: PUF_CON_phase
+    void supplicant_con(MPI &t) {
+        PUF_CON puf_con;
+        t = rand();
+        puf_con.T = G*t;
+        puf_con.calc();
+        memcpy(con_frame, puf_con.binary(), puf_con.header_len());
+    }
+
+    // Authenticator: PUF_CON_phase and PUF_SYN_phase
+    void authenticator_syn(MPI &d, ECP_Point &T) {
+        PUF_CON puf_con;
+        PUF_SYN puf_syn;
+        MPI c, k;
+        ECP_Point K;
+
+        puf_con.from_binary(con_frame, puf_con.header_len());
+        T = puf_con.T;
+        d = rand();
+        c = rand();
+        puf_syn.d = d;
+        puf_syn.C = G*c;
+        K = T*c;
+        k = K.MBEDTLS_PRIVATE(X);
+        puf_syn.calc();
+        memcpy(syn_frame, puf_syn.binary(), puf_syn.header_len());
+    }
+
+    // Supplicant: PUF_SYN_phase and PUF_ACK_phase
+    void supplicant_ack(const MPI &t) {
+        PUF_SYN puf_syn;
+        PUF_SYN_ACK puf_syn_ack;
+        MPI k;
+
+        puf_syn.from_binary(syn_frame, puf_syn.header_len());
+        k = (puf_syn.C*t).MBEDTLS_PRIVATE(X);
+        puf_syn_ack.S = G*(t + (a*puf_syn.d));
+        puf_syn_ack.calc();
+        memcpy(ack_frame, puf_syn_ack.binary(), puf_syn_ack.header_len());
+    }
+
+    // Authenticator: PUF_ACK_phase
+    bool authenticator_ack(const MPI &d, const ECP_Point &T) {
+        PUF_SYN_ACK puf_syn_ack;
+
+        puf_syn_ack.from_binary(ack_frame, puf_syn_ack.header_len());
+        return verify_muladd(puf_syn_ack.S, d, A, T);
+    }
+} Handshake;
+
+
+static void bench_handshake(int iterations) {
+    Handshake hs;
+    MPI t, d;
+    ECP_Point T;
+    uint64_t sup_ns = 0, sup_cycles = 0, auth_ns = 0, auth_cycles = 0;
+    uint64_t ns, cycles;
+
+    for(int i=0; i<iterations; ++i) {
+        ns = now_ns(); cycles = CYCLES();
+        hs.supplicant_con(t);
+        sup_ns += now_ns() - ns; sup_cycles += CYCLES() - cycles;
+
+        ns = now_ns(); cycles = CYCLES();
+        hs.authenticator_syn(d, T);
+        auth_ns += now_ns() - ns; auth_cycles += CYCLES() - cycles;
+
+        ns = now_ns(); cycles = CYCLES();
+        hs.supplicant_ack(t);
+        sup_ns += now_ns() - ns; sup_cycles += CYCLES() - cycles;
+
+        ns = now_ns(); cycles = CYCLES();
+        bool ok = hs.authenticator_ack(d, T);
+        auth_ns += now_ns() - ns; auth_cycles += CYCLES() - cycles;
+
+        if(!ok) {
+            puts("Handshake verification failed");
+            exit(1);
+        }
+    }
+
+    report("handshake: supplicant", iterations, sup_ns, sup_cycles);
+    report("handshake: authenticator", iterations, auth_ns, auth_cycles);
+}
+
+
+static void bench_generator(int iterations) {
+    mbedtls_ecp_group &grp = PUFStatics::instance().ecp_group();
+    mbedtls_ecp_point R;
+    MPI m;
+    uint8_t buf[32];
+    uint64_t ns, cycles;
+
+    mbedtls_ecp_point_init(&R);
+    for(size_t i=0; i<sizeof(buf); ++i) {
+        buf[i] = rand();
+    }
+    buf[31] &= 0x7f;
+    m.from_binary(buf, sizeof(buf));
+
+    ns = now_ns(); cycles = CYCLES();
+    for(int i=0; i<iterations; ++i) {
+        mbedtls_ecp_mul(&grp, &R, &m, &grp.G, mbedtls_ctr_drbg_random, &PUFStatics::instance().ctr_drbg_context());
+    }
+    report("G*m: mbedtls_ecp_mul", iterations, now_ns() - ns, CYCLES() - cycles);
+
+    mbedtls_ecp_point_free(&R);
+}
+
+
+static void bench_short_scalar(int iterations) {
+    mbedtls_ecp_group &grp = PUFStatics::instance().ecp_group();
+    ECP_Point G(grp.G);
+    ECP_Point A = G*MPI(0x5a5a5a5a5a5aLL);
+    ECP_Point T = G*MPI(rand());
+    const int lengths[2] = {32, 48};
+    char name[64];
+    uint64_t ns, cycles;
+    int ok = 0;
+
+    for(int l=0; l<2; ++l) {
+        uint8_t buf[6];
+        MPI m;
+        mbedtls_ecp_point R;
+
+        for(int i=0; i<6; ++i) {
+            buf[i] = rand();
+        }
+        buf[lengths[l]/8 - 1] |= 0x80;
+        m.from_binary(buf, lengths[l]/8);
+        mbedtls_ecp_point_init(&R);
+        ECP_Point S = A*m + T;
+
+        ns = now_ns(); cycles = CYCLES();
+        for(int i=0; i<iterations; ++i) {
+            mbedtls_ecp_mul(&grp, &R, &m, &A, mbedtls_ctr_drbg_random, &PUFStatics::instance().ctr_drbg_context());
+        }
+        snprintf(name, sizeof(name), "A*m (%d bit): mbedtls_ecp_mul", lengths[l]);
+        report(name, iterations, now_ns() - ns, CYCLES() - cycles);
+
+        ns = now_ns(); cycles = CYCLES();
+        for(int i=0; i<iterations; ++i) {
+            ok += verify_muladd(S, m, A, T);
+        }
+        snprintf(name, sizeof(name), "A*m + T (%d bit): verify_muladd", lengths[l]);
+        report(name, iterations, now_ns() - ns, CYCLES() - cycles);
+
+        mbedtls_ecp_point_free(&R);
+    }
+
+    if(ok != 2*iterations) {
+        puts("Verification failed");
+        exit(1);
+    }
+}
+
+
+static void bench_verify(int iterations) {
+    ECP_Point G(PUFStatics::instance().ecp_group().G);
+    MPI a(0x5a5a5a5a5a5aLL), t(rand()), d(rand());
+    ECP_Point A = G*a;
+    ECP_Point T = G*t;
+    ECP_Point S = G*(t + a*d);
+    uint64_t ns, cycles;
+    int ok = 0;
+
+    ns = now_ns(); cycles = CYCLES();
+    for(int i=0; i<iterations; ++i) {
+        ECP_Point S_ = A*d + T;
+        ok += S == S_;
+    }
+    report("S == A*d + T: ecp_mul + muladd", iterations, now_ns() - ns, CYCLES() - cycles);
+
+    ns = now_ns(); cycles = CYCLES();
+    for(int i=0; i<iterations; ++i) {
+        ok += verify_muladd(S, d, A, T);
+    }
+    report("S == A*d + T: verify_muladd", iterations, now_ns() - ns, CYCLES() - cycles);
+
+    // Table setup is paid once per device on a cache miss
+    FixedBase A_table(PUFStatics::instance().ecp_group(), KEY_TABLE_WINDOW, &A, KEY_TABLE_BITS);
+    ns = now_ns(); cycles = CYCLES();
+    ok += verify_muladd(S, d, A, T, &A_table);
+    report("S == A*d + T: key table miss", 1, now_ns() - ns, CYCLES() - cycles);
+
+    ns = now_ns(); cycles = CYCLES();
+    for(int i=0; i<iterations; ++i) {
+        ok += verify_muladd(S, d, A, T, &A_table);
+    }
+    report("S == A*d + T: key table hit", iterations, now_ns() - ns, CYCLES() - cycles);
+
+    if(ok != 3*iterations + 1) {
+        puts("Verification failed");
+        exit(1);
+    }
+}
+
+
+static void bench_batch(int n) {
+    ECP_Point G(PUFStatics::instance().ecp_group().G);
+    std::vector<ECP_Point> S(n), A(n), T(n);
+    std::vector<MPI> d(n);
+    std::vector<bool> ok;
+    BatchVerifier batch(n, 1000000, 2);     // Batch equation at any size, to compare with single checks
+    uint64_t ns, cycles;
+    int valid = 0;
+
+    for(int i=0; i<n; ++i) {
+        MPI a(rand()), t(rand());
+        d[i] = rand();
+        A[i] = G*a;
+        T[i] = G*t;
+        S[i] = G*(t + a*d[i]);
+    }
+
+    ns = now_ns(); cycles = CYCLES();
+    for(int i=0; i<n; ++i) {
+        valid += verify_muladd(S[i], d[i], A[i], T[i]);
+    }
+    report("batch: verify_muladd each", n, now_ns() - ns, CYCLES() - cycles);
+
+    ns = now_ns(); cycles = CYCLES();
+    for(int i=0; i<n; ++i) {
+        batch.push(S[i], d[i], A[i], T[i]);
+    }
+    batch.verify(ok);
+    report("batch: BatchVerifier", n, now_ns() - ns, CYCLES() - cycles);
+
+    for(int i=0; i<n; ++i) {
+        valid += ok[i];
+    }
+    if(valid != 2*n) {
+        puts("Verification failed");
+        exit(1);
+    }
+}
+
+
+static int sha256_ref(const uint8_t *in, size_t n, uint8_t *out) {
+#if MBEDTLS_VERSION_MAJOR >= 3
+    return mbedtls_sha256(in, n, out, 0);
+#else
+    return mbedtls_sha256_ret(in, n, out, 0);
+#endif
+}
+
+
+/* Single hashes of MACs (6 bytes) and of the hash chain (36 bytes) */
+static void bench_hash(int iterations) {
+    const int rounds = iterations * 1000;
+    uint8_t in[SHA256_CHAIN_LEN], out[32];
+    uint64_t ns, cycles;
+    char name[64];
+
+    for(size_t i=0; i<sizeof(in); ++i) {
+        in[i] = rand();
+    }
+
+    // Every hash depends on the previous one, as in a hash chain
+    ns = now_ns(); cycles = CYCLES();
+    for(int r=0; r<rounds; ++r) {
+        sha256_ref(in, 6, out);
+        memcpy(in, out, 6);
+    }
+    report_ns("hash 6 bytes: mbedtls_sha256", rounds, now_ns() - ns, CYCLES() - cycles);
+
+    ns = now_ns(); cycles = CYCLES();
+    for(int r=0; r<rounds; ++r) {
+        sha256_ref(in, SHA256_CHAIN_LEN, out);
+        memcpy(in, out, 32);
+    }
+    report_ns("hash 36 bytes: mbedtls_sha256", rounds, now_ns() - ns, CYCLES() - cycles);
+
+    for(unsigned lanes : {1u, 0u}) {
+        const char *impl = lanes == 1 ? "portable" : "best";
+        sha256_select(lanes);
+
+        ns = now_ns(); cycles = CYCLES();
+        for(int r=0; r<rounds; ++r) {
+            sha256_mac(in, out);
+            memcpy(in, out, 6);
+        }
+        snprintf(name, sizeof(name), "hash 6 bytes: sha256_mac %s", impl);
+        report_ns(name, rounds, now_ns() - ns, CYCLES() - cycles);
+
+        ns = now_ns(); cycles = CYCLES();
+        for(int r=0; r<rounds; ++r) {
+            sha256_chain(in, out);
+            memcpy(in, out, 32);
+        }
+        snprintf(name, sizeof(name), "hash 36 bytes: sha256_chain %s", impl);
+        report_ns(name, rounds, now_ns() - ns, CYCLES() - cycles);
+    }
+}
+
+
+/* Startup of a store: every device one step further along its MAC chain */
+static void bench_mac_chain() {
+    const uint32_t length = 1 << 16;
+    MAC base = {{0x02, 0x00, 0x00, 0x00, 0x00, 0x01}};
+    uint64_t ns, cycles;
+
+    std::vector<MAC> macs(length);
+    for(uint32_t i=0; i<length; ++i) {
+        macs[i] = base;
+        macs[i].bytes[2] = i >> 8;
+        macs[i].bytes[3] = i;
+    }
+    ns = now_ns(); cycles = CYCLES();
+    for(uint32_t i=0; i<length; ++i) {
+        macs[i].hash(1);
+    }
+    report_ns("mac chain: MAC::hash(1) per device", length, now_ns() - ns, CYCLES() - cycles);
+
+    ns = now_ns(); cycles = CYCLES();
+    advance_macs(macs.data(), length, 1);
+    report_ns("mac chain: advance_macs()", length, now_ns() - ns, CYCLES() - cycles);
+}
+
+
+/* Hash chain of the data frames, 36 byte inputs */
+static void bench_chain_hash(int iterations) {
+    const int n = VALIDATE_BATCH_MAX;
+    const int rounds = iterations * 100;
+    std::vector<uint8_t> in(n * SHA256_CHAIN_LEN), out(n * 32);
+    uint64_t ns, cycles;
+    char name[64];
+
+    for(size_t i=0; i<in.size(); ++i) {
+        in[i] = rand();
+    }
+
+    ns = now_ns(); cycles = CYCLES();
+    for(int r=0; r<rounds; ++r) {
+        for(int i=0; i<n; ++i) {
+            sha256_ref(&in[i*SHA256_CHAIN_LEN], SHA256_CHAIN_LEN, &out[i*32]);
+        }
+    }
+    report_ns("chain hash: mbedtls_sha256", rounds * n, now_ns() - ns, CYCLES() - cycles);
+
+    for(unsigned lanes : {1u, 8u, 16u}) {
+        sha256_select(lanes);
+        if( sha256_lanes() != lanes ) continue;
+
+        ns = now_ns(); cycles = CYCLES();
+        for(int r=0; r<rounds; ++r) {
+            sha256_chain_many(in.data(), out.data(), n);
+        }
+        snprintf(name, sizeof(name), "chain hash: %u lanes", lanes);
+        report_ns(name, rounds * n, now_ns() - ns, CYCLES() - cycles);
+    }
+    sha256_select(0);
+}
+
+
+/* Hash chain advance as in Authenticator::validate(), one thread per shard of flows */
+static void bench_chain_threads(int iterations) {
+    const size_t flows = 4096;
+    const int rounds = iterations * 10;
+    const unsigned max_threads = std::thread::hardware_concurrency();
+    ChainTable table(flows);
+    std::vector<MAC> macs(flows);
+    const uint8_t k[4] = {1, 2, 3, 4};
+    char name[64];
+
+    for(size_t f=0; f<flows; ++f) {
+        for(size_t b=0; b<sizeof(MAC); ++b) {
+            macs[f].bytes[b] = rand();
+        }
+        table.insert(macs[f], k);
+    }
+
+    for(unsigned threads=1; threads<=max_threads && threads<=table.shards(); threads*=2) {
+        std::vector<std::thread> workers;
+        uint64_t ns = now_ns();
+
+        for(unsigned w=0; w<threads; ++w) {
+            workers.emplace_back([&, w]() {
+                uint8_t in[SHA256_CHAIN_LEN];
+                for(int r=0; r<rounds; ++r) {
+                    for(size_t f=0; f<flows; ++f) {
+                        if( table.shard_of(macs[f]) % threads != w ) continue;
+                        ChainState *c = table.find(macs[f]);
+                        memcpy(in, c->hk_mac, sizeof(c->hk_mac));
+                        memcpy(in + sizeof(c->hk_mac), c->k, sizeof(c->k));
+                        sha256_chain(in, c->hk_mac);
+                    }
+                }
+            });
+        }
+        for(std::thread &t : workers) {
+            t.join();
+        }
+
+        ns = now_ns() - ns;
+        snprintf(name, sizeof(name), "chain advance: %u threads", threads);
+        printf("%-40s %10.1f Mframes/s\n", name, 1000.0 * rounds * flows / ns);
+    }
+}
+
+
+/* Device store on a memory mapped file: registration, startup and lookups */
+static void bench_store(int iterations) {
+    const char *path = "/tmp/puf_bench_store.db";
+    const size_t devices = 1 << 18;
+    const int rounds = iterations * 1000;
+    ECP_Point A(PUFStatics::instance().ecp_group().G);
+    std::vector<MAC> macs(devices);
+    MAC base = {{0x02, 0, 0, 0, 0, 0}};
+
+    for(size_t i=0; i<devices; ++i) {
+        for(size_t b=0; b<sizeof(MAC); ++b) {
+            macs[i].bytes[b] = rand();
+        }
+    }
+
+    unlink(path);
+    {
+        MappedAuthenticationServer as(path, devices * 2);
+        as.fetch();
+        uint64_t ns = now_ns(), cycles = CYCLES();
+        for(size_t i=0; i<devices; ++i) {
+            as.store(base, A, macs[i], DEFAULT_COUNTER);
+        }
+        report_ns("store: store", devices, now_ns() - ns, CYCLES() - cycles);
+        as.sync();
+    }
+
+    MappedAuthenticationServer as(path);
+    uint64_t ns = now_ns(), cycles = CYCLES();
+    as.fetch();
+    ns = now_ns() - ns;
+    cycles = CYCLES() - cycles;
+    printf("%-40s %10.1f us for %zu devices\n", "store: fetch", ns / 1000.0, devices);
+
+    ns = now_ns(); cycles = CYCLES();
+    for(int i=0; i<rounds; ++i) {
+        as.counter( macs[(i * 7919) % devices] );
+    }
+    report_ns("store: lookup", rounds, now_ns() - ns, CYCLES() - cycles);
+
+    ns = now_ns(); cycles = CYCLES();
+    for(int i=0; i<rounds; ++i) {
+        as.query( macs[(i * 7919) % devices] );
+    }
+    report_ns("store: query", rounds, now_ns() - ns, CYCLES() - cycles);
+    unlink(path);
+}
+
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+
+    srand(1);
+    bench_generator(iterations);
+    bench_short_scalar(iterations);
+    bench_verify(iterations);
+    bench_batch(iterations);
+    bench_handshake(iterations);
+    bench_hash(iterations);
+    bench_mac_chain();
+    bench_chain_hash(iterations);
+    bench_chain_threads(iterations);
+    bench_store(iterations);
+    return 0;
+}
@@ -0,0 +1,193 @@
+/**
+ * End-to-end benchmark of Supplicant and Authenticator in one process, linked by a
+ * LoopbackNetwork and backed by SoftwarePUFs and a MemoryAuthenticationServer.
+ * Measures sign-up, full handshakes and per-frame transmit/validate latency and
+ * throughput. Runs are deterministic for the same arguments.
+ *
+ * Build from the repository root, e.g.
+ *   g++ -O2 -std=c++17 -pthread -I. *.cpp bench/end_to_end.cpp -lmbedcrypto -o puf_e2e
+ * and run as
+ *   ./puf_e2e [devices] [frames] [data length]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "authenticator.h"
+#include "supplicant.h"
+#include "loopback_network.h"
+#include "memory_server.h"
+#include "software_puf.h"
+
+using namespace puf;
+
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* Sign-up and handshakes print progress, which would dominate the timings */
+static void quiet(bool enable) {
+    static int saved = -1;
+    fflush(stdout);
+    if(enable && saved < 0) {
+        saved = dup(STDOUT_FILENO);
+        FILE *null = fopen("/dev/null", "w");
+        dup2(fileno(null), STDOUT_FILENO);
+        fclose(null);
+    } else if(!enable && saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        saved = -1;
+    }
+}
+
+
+static void report_latency(const char *name, std::vector<uint64_t> &ns) {
+    std::sort(ns.begin(), ns.end());
+    uint64_t sum = 0;
+    for(uint64_t v : ns) sum += v;
+    printf("%-32s %10.1f us mean %10.1f us p50 %10.1f us p99 %12.0f ops/s\n", name,
+        sum / 1000.0 / ns.size(), ns[ns.size() / 2] / 1000.0, ns[ns.size() * 99 / 100] / 1000.0,
+        ns.size() * 1e9 / sum);
+}
+
+
+static void report_rate(const char *name, size_t frames, size_t bytes, uint64_t ns) {
+    printf("%-32s %10.1f ns/frame %10.3f Mframes/s %8.3f Gbit/s\n", name,
+        static_cast<double>(ns) / frames, frames * 1e3 / ns, bytes * 8.0 / ns);
+}
+
+
+int main(int argc, char **argv) {
+    const size_t devices = argc > 1 ? atoi(argv[1]) : 64;
+    const size_t frames = argc > 2 ? atoi(argv[2]) : 100000;
+    const size_t data_len = argc > 3 ? atoi(argv[3]) : 64;
+
+    if(devices == 0 || data_len > ETHER_FRAME_LEN - PUF_PERFORMANCE_HEADROOM) {
+        fprintf(stderr, "usage: %s [devices > 0] [frames] [data length <= %zu]\n", argv[0],
+            static_cast<size_t>(ETHER_FRAME_LEN - PUF_PERFORMANCE_HEADROOM));
+        return 1;
+    }
+
+    srand(1);
+    MemoryAuthenticationServer as;
+    LoopbackNetwork sn, an;
+    LoopbackNetwork::connect(sn, an);
+
+    Authenticator auth(an, as);
+    auth.init();
+
+    std::vector<std::unique_ptr<SoftwarePUF>> pufs;
+    std::vector<std::unique_ptr<Supplicant>> sups;
+    std::vector<uint64_t> ns(devices);
+
+    // Sign-up: REGISTER and storing the public key
+    quiet(true);
+    for(size_t i=0; i<devices; ++i) {
+        pufs.emplace_back(new SoftwarePUF(i + 1));
+        sups.emplace_back(new Supplicant(sn, *pufs[i]));
+        const uint64_t t0 = now_ns();
+        sups[i]->init();
+        sups[i]->sign_up();
+        auth.sign_up();
+        ns[i] = now_ns() - t0;
+    }
+    quiet(false);
+    report_latency("sign-up", ns);
+
+    // Full handshakes, one at a time, from PUF_CON to the verified PUF_SYN_ACK
+    std::atomic<size_t> done(0);
+    std::vector<uint64_t> start(devices);
+    size_t connected = 0;
+    quiet(true);
+    std::thread supplicants([&]{
+        for(size_t i=0; i<devices; ++i) {
+            while( done.load() < i ) std::this_thread::yield();
+            start[i] = now_ns();
+            sups[i]->connect(1);
+        }
+    });
+    for(size_t i=0; i<devices; ++i) {
+        uint8_t buf[ETHER_FRAME_LEN];
+        int n = an.receive(buf, sizeof(buf));
+        if( n > 0 && auth.accept(buf, n) == 0 ) {
+            connected++;
+        }
+        ns[i] = now_ns() - start[i];
+        done.store(i + 1);
+    }
+    supplicants.join();
+    quiet(false);
+    report_latency("handshake", ns);
+    if(connected != devices) {
+        printf("%zu of %zu handshakes failed\n", devices - connected, devices);
+        return 1;
+    }
+
+    // Throughput: frames of all devices round robin, validated in bursts
+    std::vector<uint8_t> data(data_len, 0x5a);
+    std::vector<uint8_t> rx(VALIDATE_BATCH_MAX * ETHER_FRAME_LEN);
+    Frame burst[VALIDATE_BATCH_MAX];
+    std::vector<HandshakeEvent> events;
+    size_t sent = 0, valid = 0, bytes = 0;
+    uint64_t tx_ns = 0, rx_ns = 0;
+
+    while(sent < frames) {
+        const size_t n = std::min(frames - sent, static_cast<size_t>(LOOPBACK_QUEUE_LEN));
+        uint64_t t0 = now_ns();
+        for(size_t i=0; i<n; ++i) {
+            const size_t d = (sent + i) % devices;
+            sups[d]->transmit(data.data(), data.size(), sent + i < devices);
+        }
+        tx_ns += now_ns() - t0;
+
+        t0 = now_ns();
+        for(size_t left = n; left > 0; ) {
+            for(size_t i=0; i<VALIDATE_BATCH_MAX; ++i) {
+                burst[i] = {&rx[i * ETHER_FRAME_LEN], 0, ETHER_FRAME_LEN};
+            }
+            const size_t m = an.receive_batch(burst, std::min(left, static_cast<size_t>(VALIDATE_BATCH_MAX)));
+            if(m == 0) break;
+            valid += __builtin_popcountll( auth.handle_burst(burst, m, events) );
+            for(size_t i=0; i<m; ++i) bytes += burst[i].len;
+            left -= m;
+        }
+        rx_ns += now_ns() - t0;
+        sent += n;
+    }
+    report_rate("transmit", sent, bytes, tx_ns);
+    report_rate("receive + validate", sent, bytes, rx_ns);
+    report_rate("end to end", sent, bytes, tx_ns + rx_ns);
+    if(valid != sent) {
+        printf("%zu of %zu frames invalid\n", sent - valid, sent);
+        return 1;
+    }
+
+    // Latency of a single frame from transmit() to validate()
+    const size_t rounds = std::min(frames, static_cast<size_t>(10000));
+    std::vector<uint64_t> frame_ns(rounds);
+    uint8_t buf[ETHER_FRAME_LEN];
+    PUF_PerformanceView pv;
+    for(size_t i=0; i<rounds; ++i) {
+        const uint64_t t0 = now_ns();
+        sups[0]->transmit(data.data(), data.size(), i == 0);
+        int n = an.receive(buf, sizeof(buf));
+        pv.from_binary(buf, n);
+        valid += auth.validate(pv, i == 0);
+        frame_ns[i] = now_ns() - t0;
+    }
+    report_latency("frame", frame_ns);
+    return 0;
+}
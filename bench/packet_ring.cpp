@@ -0,0 +1,146 @@
+/**
+ * Throughput of PacketRingNetwork between two interfaces, e.g. a veth pair with one
+ * end in a network namespace:
+ *   ip netns add puf
+ *   ip link add puf0 type veth peer name puf1 netns puf
+ *   ip link set puf0 up
+ *   ip netns exec puf ip link set puf1 up
+ *
+ * Build from the repository root, e.g.
+ *   g++ -O2 -std=c++17 -pthread -I. *.cpp bench/packet_ring.cpp -lmbedcrypto -o puf_ring_bench
+ * and run as root with the receiving end first
+ *   ip netns exec puf ./puf_ring_bench rx puf1 [frames] [copy]
+ *   ./puf_ring_bench tx puf0 [frames] [frame length]
+ * or both ends in one process on interfaces of the same namespace
+ *   ./puf_ring_bench both puf0 puf1 [frames] [frame length]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <thread>
+#include <vector>
+
+#include "packet_ring.h"
+
+using namespace puf;
+
+
+#define BURST   VALIDATE_BATCH_MAX
+
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void report(const char *what, size_t frames, size_t bytes, uint64_t ns) {
+    const double s = ns / 1e9;
+    printf("%-8s %10zu frames  %8.3f Mframes/s  %8.3f Gbit/s\n", what, frames, frames / s / 1e6, bytes * 8 / s / 1e9);
+}
+
+
+static void run_tx(const char *ifname, size_t count, size_t frame_len) {
+    PacketRingNetwork net(ifname);
+    net.init();
+
+    // Data frames of a single flow, the payload does not matter here
+    std::vector<uint8_t> buf(frame_len * BURST, 0);
+    Frame frames[BURST];
+    for(size_t i=0; i<BURST; ++i) {
+        uint8_t *f = buf.data() + i * frame_len;
+        memset(f, 0xff, 6);
+        memset(f + 6, 0x02, 6);
+        f[12] = ETHER_TYPE_AD >> 8;
+        f[13] = ETHER_TYPE_AD & 0xff;
+        frames[i] = {f, frame_len, frame_len};
+    }
+
+    const uint64_t t0 = now_ns();
+    size_t sent = 0;
+    while(sent < count) {
+        const size_t n = count - sent < BURST ? count - sent : BURST;
+        sent += net.send_batch(frames, n);
+    }
+    report("tx", sent, sent * frame_len, now_ns() - t0);
+}
+
+
+static void run_rx(const char *ifname, size_t count, bool copy) {
+    PacketRingNetwork net(ifname);
+    net.init();
+
+    std::vector<uint8_t> buf(ETHER_FRAME_LEN * BURST);
+    Frame frames[BURST];
+    size_t received = 0, bytes = 0;
+    uint64_t t0 = 0, t1 = 0;
+
+    // Stop once all frames arrived or none came for 1 s
+    while(received < count) {
+        size_t n;
+        if(copy) {
+            for(size_t i=0; i<BURST; ++i) {
+                frames[i] = {buf.data() + i * ETHER_FRAME_LEN, 0, ETHER_FRAME_LEN};
+            }
+            n = net.receive_batch(frames, BURST);
+        } else {
+            n = net.receive_in_place(frames, BURST, t0 == 0 ? NETWORK_TIMEOUT_MS : 1000);
+        }
+        if(n == 0) {
+            if(t0 != 0) {
+                break;
+            }
+            continue;
+        }
+        if(t0 == 0) {
+            t0 = now_ns();
+        }
+        t1 = now_ns();
+        for(size_t i=0; i<n; ++i) {
+            bytes += frames[i].len;
+        }
+        received += n;
+    }
+
+    report(copy ? "rx copy" : "rx", received, bytes, t1 - t0);
+    if(received < count) {
+        printf("lost     %10zu frames\n", count - received);
+    }
+}
+
+
+int main(int argc, char **argv) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s rx <if> [frames] [copy]\n"
+                        "       %s tx <if> [frames] [frame length]\n"
+                        "       %s both <tx if> <rx if> [frames] [frame length]\n", argv[0], argv[0], argv[0]);
+        return 1;
+    }
+
+    try {
+        if( strcmp(argv[1], "rx") == 0 ) {
+            run_rx(argv[2], argc > 3 ? atol(argv[3]) : 1000000, argc > 4 && strcmp(argv[4], "copy") == 0);
+        } else if( strcmp(argv[1], "tx") == 0 ) {
+            run_tx(argv[2], argc > 3 ? atol(argv[3]) : 1000000, argc > 4 ? atol(argv[4]) : ETHER_MIN_FRAME_LEN);
+        } else if( strcmp(argv[1], "both") == 0 && argc > 3 ) {
+            const size_t count = argc > 4 ? atol(argv[4]) : 1000000;
+            const size_t frame_len = argc > 5 ? atol(argv[5]) : ETHER_MIN_FRAME_LEN;
+            std::thread rx(run_rx, argv[3], count, false);
+            // Give the receiver time to set up its ring
+            struct timespec ts = {0, 100000000};
+            nanosleep(&ts, NULL);
+            run_tx(argv[2], count, frame_len);
+            rx.join();
+        } else {
+            fprintf(stderr, "unknown mode %s\n", argv[1]);
+            return 1;
+        }
+    } catch(const puf::Exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,330 @@
+/**
+ * Checks of the crash handling of WriteAheadLog and of the lookahead window of
+ * ChainIndex, the parts of MappedAuthenticationServer that a benchmark never
+ * exercises:
+ *  - replay after a torn last record
+ *  - a crash between switching segments and emptying the old one in checkpoint()
+ *  - a failed write, after which the records not yet on disk are lost
+ *  - ChainIndex::roll() keeping exactly K identities per device
+ *
+ * Build from the repository root, e.g.
+ *   g++ -O2 -std=c++17 -pthread -I. *.cpp bench/store_check.cpp -lmbedcrypto -o puf_store_check
+ * and run without arguments. Exits with 1 if a check fails.
+*/
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+
+#include "errors.h"
+#include "wal.h"
+#include "chain_index.h"
+
+using namespace puf;
+
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+        if( !(cond) ) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while(0)
+
+
+static std::string segment(const std::string &path, int i) {
+    return path + "." + std::to_string(i);
+}
+
+
+static void remove_log(const std::string &path) {
+    unlink(segment(path, 0).c_str());
+    unlink(segment(path, 1).c_str());
+}
+
+
+static off_t file_size(const std::string &file) {
+    struct stat st;
+    return stat(file.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+
+/* Appends and commits records whose ctr runs from first to first+n-1 */
+static void append_records(WriteAheadLog &wal, int first, int n) {
+    for(int i=0; i<n; ++i) {
+        WalRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.type = WAL_COUNTER_E;
+        rec.ctr = first + i;
+        wal.commit( wal.append(rec) );
+    }
+}
+
+
+/* Opens the log and returns the ctr of every replayed record in order */
+static std::vector<int> replay(WriteAheadLog &wal) {
+    std::vector<int> ctrs;
+    wal.open([&ctrs](const WalRecord &rec) {
+        ctrs.push_back(rec.ctr);
+    });
+    return ctrs;
+}
+
+
+static std::vector<int> range(int first, int n) {
+    std::vector<int> v;
+    for(int i=0; i<n; ++i) {
+        v.push_back(first + i);
+    }
+    return v;
+}
+
+
+static void check_torn_tail(const std::string &path) {
+    remove_log(path);
+    {
+        WriteAheadLog wal(path);
+        replay(wal);
+        wal.checkpoint([]{});
+        append_records(wal, 0, 5);
+    }
+
+    // A crash in the middle of the last write leaves half a record
+    const std::string file = file_size(segment(path, 0)) > file_size(segment(path, 1)) ? segment(path, 0)
+                                                                                      : segment(path, 1);
+    CHECK( truncate(file.c_str(), file_size(file) - sizeof(WalRecord) / 2) == 0 );
+
+    {
+        WriteAheadLog wal(path);
+        CHECK( replay(wal) == range(0, 4) );
+
+        // After the checkpoint new records are no longer hidden by the torn one
+        wal.checkpoint([]{});
+        append_records(wal, 10, 2);
+    }
+    {
+        WriteAheadLog wal(path);
+        CHECK( replay(wal) == range(10, 2) );
+    }
+    puts("torn tail: done");
+}
+
+
+static void check_checkpoint_crash(const std::string &path) {
+    remove_log(path);
+
+    pid_t pid = fork();
+    if(pid == 0) {
+        WriteAheadLog wal(path);
+        replay(wal);
+        wal.checkpoint([]{});
+        append_records(wal, 0, 3);
+
+        // Dies while the store is written back: the new segment already takes
+        // records, the old one is not emptied yet
+        wal.checkpoint([&wal]() {
+            append_records(wal, 3, 2);
+            _exit(0);
+        });
+        _exit(1);
+    }
+    int status;
+    CHECK( waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0 );
+
+    {
+        WriteAheadLog wal(path);
+        CHECK( replay(wal) == range(0, 5) );        // Old segment first
+
+        // The next checkpoint completes and drops both
+        wal.checkpoint([]{});
+        append_records(wal, 5, 1);
+    }
+    {
+        WriteAheadLog wal(path);
+        CHECK( replay(wal) == range(5, 1) );
+    }
+    puts("crash in checkpoint: done");
+}
+
+
+static void check_lost_records(const std::string &path) {
+    struct rlimit saved, limit;
+    remove_log(path);
+
+    {
+        WriteAheadLog wal(path);
+        replay(wal);
+        wal.checkpoint([]{});
+        append_records(wal, 0, 3);
+
+        // Writes beyond the limit fail with EFBIG, the next record is torn
+        const off_t size = file_size(segment(path, 0)) > file_size(segment(path, 1)) ? file_size(segment(path, 0))
+                                                                                     : file_size(segment(path, 1));
+        signal(SIGXFSZ, SIG_IGN);
+        getrlimit(RLIMIT_FSIZE, &saved);
+        limit = saved;
+        limit.rlim_cur = size + sizeof(WalRecord) / 2;
+        setrlimit(RLIMIT_FSIZE, &limit);
+
+        WalRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.type = WAL_COUNTER_E;
+        rec.ctr = 3;
+        const uint64_t lsn = wal.append(rec);
+
+        bool failed = false;
+        try {
+            wal.commit(lsn);
+        } catch(const Exception &e) {
+            failed = true;
+        }
+        CHECK(failed);
+
+        // The failure is final, durable records stay durable
+        failed = false;
+        try {
+            wal.commit(lsn);
+        } catch(const Exception &e) {
+            failed = true;
+        }
+        CHECK(failed);
+        failed = false;
+        try {
+            wal.commit(lsn - 1);
+        } catch(const Exception &e) {
+            failed = true;
+        }
+        CHECK(!failed);
+
+        failed = false;
+        try {
+            wal.append(rec);
+        } catch(const Exception &e) {
+            failed = true;
+        }
+        CHECK(failed);
+
+        // A checkpoint still writes the store back, but reports the loss
+        int synced = 0;
+        failed = false;
+        try {
+            wal.checkpoint([&synced]{ synced++; });
+        } catch(const Exception &e) {
+            failed = true;
+        }
+        CHECK(failed && synced == 1);
+
+        setrlimit(RLIMIT_FSIZE, &saved);
+    }
+
+    // Opening the log again starts over with what reached the disk
+    {
+        WriteAheadLog wal(path);
+        CHECK( replay(wal) == range(0, 3) );
+        wal.checkpoint([]{});
+        append_records(wal, 4, 1);
+    }
+    {
+        WriteAheadLog wal(path);
+        CHECK( replay(wal) == range(4, 1) );
+    }
+    signal(SIGXFSZ, SIG_DFL);
+    puts("lost records: done");
+}
+
+
+/* Checks that device is found under exactly h_step, ..., h_{step+K-1} */
+static void check_window(const ChainIndex &index, uint64_t device, const MAC &mac, uint32_t step) {
+    const unsigned K = index.lookahead();
+    MAC h = mac;
+    uint64_t found;
+    uint16_t s;
+
+    for(unsigned k=0; k<K; ++k) {
+        CHECK( index.find(h, found, s) && found == device && ChainIndex::step_of(s, step) == step + k );
+        h.hash(1);
+    }
+    CHECK( !index.find(h, found, s) );
+}
+
+
+static void check_roll() {
+    const unsigned K = CHAIN_LOOKAHEAD;
+    const size_t devices = 16;
+    // Steps forward per roll: none, within the window, to its end, beyond it and past
+    // the 16 bits of a step kept in the index
+    const uint32_t steps[] = {0, 1, K - 1, K, K + 1, 2*K + 3, 0, 70000, 1};
+    ChainIndex index(K);
+    std::vector<MAC> macs(devices);
+    std::vector<uint32_t> pos(devices, 0);
+
+    for(size_t d=0; d<devices; ++d) {
+        macs[d] = {{0x02, 0x00, 0x00, 0x00, static_cast<uint8_t>(d >> 8), static_cast<uint8_t>(d)}};
+        index.add(d, macs[d], 0);
+    }
+    CHECK( index.size() == devices * K );
+
+    for(uint32_t n : steps) {
+        for(size_t d=0; d<devices; ++d) {
+            MAC expected = macs[d];
+            MAC behind = macs[d];
+            expected.hash(n);
+            if(n > 0) {
+                behind.hash(n - 1);
+            }
+
+            const MAC mac = index.roll(d, macs[d], pos[d], pos[d] + n);
+            CHECK( mac == expected );
+            macs[d] = mac;
+            pos[d] += n;
+
+            uint64_t found;
+            uint16_t s;
+            if(n > 0) {
+                CHECK( !index.find(behind, found, s) );
+            }
+            check_window(index, d, macs[d], pos[d]);
+        }
+        CHECK( index.size() == devices * K );
+    }
+
+    for(size_t d=0; d<devices; ++d) {
+        index.remove(d, macs[d]);
+    }
+    CHECK( index.size() == 0 );
+    puts("ChainIndex::roll: done");
+}
+
+
+int main() {
+    char dir[] = "/tmp/puf_store_check.XXXXXX";
+    if( mkdtemp(dir) == NULL ) {
+        perror("mkdtemp");
+        return 1;
+    }
+    const std::string path = std::string(dir) + "/wal";
+
+    try {
+        check_torn_tail(path);
+        check_checkpoint_crash(path);
+        check_lost_records(path);
+        check_roll();
+    } catch(const puf::Exception& e) {
+        printf("%s\n", e.what());
+        failures++;
+    }
+
+    remove_log(path);
+    rmdir(dir);
+
+    printf("%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
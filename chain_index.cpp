@@ -0,0 +1,203 @@
+#include "chain_index.h"
+
+#include <algorithm>
+
+
+namespace puf {
+
+
+/* Device keys take 48 bits, so these never name a device */
+static const uint64_t INDEX_EMPTY  = ~static_cast<uint64_t>(0);
+static const uint64_t INDEX_ERASED = ~static_cast<uint64_t>(1);
+
+static const uint64_t MAC_BITS = (static_cast<uint64_t>(1) << 48) - 1;
+
+
+static uint64_t mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+
+ChainIndex::ChainIndex(unsigned lookahead) : used(0), erased(0), lookahead_(lookahead == 0 ? 1 : lookahead) {
+    clear();
+}
+
+
+unsigned ChainIndex::lookahead() const {
+    return lookahead_;
+}
+
+
+void ChainIndex::rehash(size_t capacity) {
+    std::vector<Entry> old;
+    old.swap(slots);
+    slots.assign(capacity, Entry{0, INDEX_EMPTY});
+    used = 0;
+    erased = 0;
+
+    const size_t mask = capacity - 1;
+    for(const Entry &e : old) {
+        if(e.device == INDEX_EMPTY || e.device == INDEX_ERASED) continue;
+        size_t i = mix(e.key & MAC_BITS) & mask;
+        while(slots[i].device != INDEX_EMPTY) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = e;
+        used++;
+    }
+}
+
+
+void ChainIndex::reserve(size_t devices) {
+    size_t capacity = slots.size();
+    while( devices * lookahead_ * 4 > capacity * 3 ) {
+        capacity <<= 1;
+    }
+    if( capacity != slots.size() ) {
+        rehash(capacity);
+    }
+}
+
+
+void ChainIndex::insert(const MAC &mac, uint64_t device, uint32_t step) {
+    // At most 3/4 of the slots taken, tombstones included
+    if( (used + erased + 1) * 4 > slots.size() * 3 ) {
+        rehash( (used + 1) * 2 > slots.size() ? slots.size() * 2 : slots.size() );
+    }
+
+    const uint64_t key = mac.to_u64();
+    const size_t mask = slots.size() - 1;
+    size_t i = mix(key) & mask;
+    while( slots[i].device != INDEX_EMPTY && slots[i].device != INDEX_ERASED ) {
+        i = (i + 1) & mask;
+    }
+    if(slots[i].device == INDEX_ERASED) {
+        erased--;
+    }
+    slots[i].key = key | static_cast<uint64_t>(step & 0xffff) << 48;
+    slots[i].device = device;
+    used++;
+}
+
+
+void ChainIndex::erase(const MAC &mac, uint64_t device) {
+    const uint64_t key = mac.to_u64();
+    const size_t mask = slots.size() - 1;
+    size_t i = mix(key) & mask;
+
+    for(; slots[i].device != INDEX_EMPTY; i = (i + 1) & mask) {
+        if( slots[i].device == device && (slots[i].key & MAC_BITS) == key ) {
+            slots[i].device = INDEX_ERASED;
+            used--;
+            erased++;
+            return;
+        }
+    }
+}
+
+
+void ChainIndex::add(uint64_t device, const MAC &mac, uint32_t step) {
+    MAC h = mac;
+    for(unsigned i=0; i<lookahead_; ++i) {
+        insert(h, device, step + i);
+        h.hash(1);
+    }
+}
+
+
+void ChainIndex::add_many(const uint64_t *devices, const MAC *macs, const uint32_t *steps, size_t n,
+                          unsigned threads) {
+    const size_t chunk = 1 << 16;
+    std::vector<MAC> chains;
+
+    reserve(size() / lookahead_ + n);
+
+    // In chunks, so that the hashed identities stay small next to the table
+    for(size_t begin = 0; begin < n; begin += chunk) {
+        const size_t m = std::min(chunk, n - begin);
+        chains.resize(m * lookahead_);
+        for(size_t i=0; i<m; ++i) {
+            chains[i * lookahead_] = macs[begin + i];
+        }
+        walk_chains(chains.data(), m, lookahead_, threads);
+
+        // The slots are random, so they are fetched a few identities ahead
+        const size_t mask = slots.size() - 1;
+        for(size_t e=0; e<m * lookahead_; ++e) {
+            if( e + 16 < m * lookahead_ ) {
+                __builtin_prefetch(&slots[mix(chains[e + 16].to_u64()) & mask], 1);
+            }
+            insert(chains[e], devices[begin + e / lookahead_], steps[begin + e / lookahead_] + e % lookahead_);
+        }
+    }
+}
+
+
+void ChainIndex::remove(uint64_t device, const MAC &mac) {
+    MAC h = mac;
+    for(unsigned i=0; i<lookahead_; ++i) {
+        erase(h, device);
+        h.hash(1);
+    }
+}
+
+
+MAC ChainIndex::roll(uint64_t device, const MAC &mac, uint32_t from, uint32_t to) {
+    MAC h = mac, cur = mac;
+
+    // Walk h from h_from to h_{to+K-1}: drop what falls behind, add what comes into reach
+    for(uint32_t s = from; s < to + lookahead_; ++s) {
+        if(s < to && s < from + lookahead_) {
+            erase(h, device);
+        }
+        if(s >= to && s >= from + lookahead_) {
+            insert(h, device, s);
+        }
+        if(s == to) {
+            cur = h;
+        }
+        h.hash(1);
+    }
+    return cur;
+}
+
+
+bool ChainIndex::find(const MAC &mac, uint64_t &device, uint16_t &step) const {
+    const uint64_t key = mac.to_u64();
+    const size_t mask = slots.size() - 1;
+    size_t i = mix(key) & mask;
+
+    for(; slots[i].device != INDEX_EMPTY; i = (i + 1) & mask) {
+        if( slots[i].device != INDEX_ERASED && (slots[i].key & MAC_BITS) == key ) {
+            device = slots[i].device;
+            step = static_cast<uint16_t>(slots[i].key >> 48);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+uint32_t ChainIndex::step_of(uint16_t step, uint32_t current) {
+    return current + static_cast<uint16_t>(step - static_cast<uint16_t>(current));
+}
+
+
+void ChainIndex::clear() {
+    slots.assign(16, Entry{0, INDEX_EMPTY});
+    used = 0;
+    erased = 0;
+}
+
+
+size_t ChainIndex::size() const {
+    return used;
+}
+
+
+};  // namespace puf
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vector>
+
+#include "mac_chain.h"
+#include "packets.h"
+
+namespace puf {
+
+
+/**
+ * Index of the upcoming identities of all devices. A device at step p of its MAC
+ * chain, i.e. currently known as h_p = H^p(h_0), is found under each of
+ * h_p, ..., h_{p+K-1} in one flat open addressing table, so a supplicant that hashed
+ * up to K-1 steps ahead of the server is looked up in constant time. Rolling a device
+ * forward to step j drops the identities before j and adds those up to j+K-1.
+ *
+ * Devices are named by a 48 bit key, e.g. their registered hashed MAC. Not
+ * thread-safe.
+*/
+class ChainIndex {
+private:
+    typedef struct Entry {
+        uint64_t key;           // Identity as MAC::to_u64(), bits 48 to 63 hold the step
+        uint64_t device;        // Device key or one of the markers
+    } Entry;
+
+    std::vector<Entry> slots;
+    size_t used;
+    size_t erased;
+    unsigned lookahead_;
+
+    void rehash(size_t capacity);
+    void insert(const MAC &mac, uint64_t device, uint32_t step);
+    void erase(const MAC &mac, uint64_t device);
+
+public:
+    /**
+     * @param lookahead Number K of identities per device. Defaults to CHAIN_LOOKAHEAD
+    */
+    ChainIndex(unsigned lookahead = CHAIN_LOOKAHEAD);
+
+    unsigned lookahead() const;
+
+    /**
+     * Prepares the table for a number of devices
+    */
+    void reserve(size_t devices);
+
+    /**
+     * Adds the identities of a device
+     * @param device Key of the device
+     * @param mac Current identity h_step
+     * @param step Current step
+    */
+    void add(uint64_t device, const MAC &mac, uint32_t step);
+
+    /**
+     * Adds the identities of many devices as add() does. The identities are hashed
+     * in parallel, see walk_chains(), and inserted afterwards.
+     * @param devices Keys of the devices
+     * @param macs Current identities
+     * @param steps Current steps
+     * @param n Number of devices
+     * @param threads Number of threads hashing, 0 for one per core
+    */
+    void add_many(const uint64_t *devices, const MAC *macs, const uint32_t *steps, size_t n, unsigned threads = 0);
+
+    /**
+     * Removes the identities added by add() or roll()
+     * @param device Key of the device
+     * @param mac Current identity
+    */
+    void remove(uint64_t device, const MAC &mac);
+
+    /**
+     * Moves a device forward from step from to step to, to >= from
+     * @param device Key of the device
+     * @param mac Current identity h_from
+     * @return The new identity h_to
+    */
+    MAC roll(uint64_t device, const MAC &mac, uint32_t from, uint32_t to);
+
+    /**
+     * Looks up an identity
+     * @param mac The identity
+     * @param device Receives the key of the device
+     * @param step Receives the lower 16 bits of the step of the identity, see step_of()
+     * @return True if found
+    */
+    bool find(const MAC &mac, uint64_t &device, uint16_t &step) const;
+
+    /**
+     * @param step Lower 16 bits of a step as returned by find()
+     * @param current Current step of the device
+     * @return The full step, in [current, current+K)
+    */
+    static uint32_t step_of(uint16_t step, uint32_t current);
+
+    void clear();
+
+    /**
+     * @return Number of indexed identities
+    */
+    size_t size() const;
+};
+
+
+};  // namespace puf
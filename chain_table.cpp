@@ -0,0 +1,237 @@
+#include "chain_table.h"
+
+#include <string.h>
+
+
+namespace puf {
+
+
+/* MACs take 48 bits, so these keys never belong to a flow */
+static const uint64_t CHAIN_EMPTY  = ~static_cast<uint64_t>(0);
+static const uint64_t CHAIN_ERASED = ~static_cast<uint64_t>(1);
+
+
+ChainState::ChainState() : key(CHAIN_EMPTY), seen_ms(0), device(CHAIN_EMPTY) {
+    memset(hk_mac, 0, sizeof(hk_mac));
+    memset(k, 0, sizeof(k));
+}
+
+
+ChainTable::ChainTable(size_t capacity, size_t shards) : shards_(shards == 0 ? 1 : shards) {
+    // Power of two slots per shard, at most half of them in use
+    size_t slots = 2;
+    while( slots < 2 * capacity / shards_.size() ) {
+        slots <<= 1;
+    }
+
+    for(Shard &sh : shards_) {
+        sh.slots = new ChainState[slots];
+        sh.mask = slots - 1;
+        sh.used = 0;
+        sh.erased = 0;
+    }
+}
+
+
+ChainTable::~ChainTable() {
+    for(Shard &sh : shards_) {
+        delete[] sh.slots;
+    }
+}
+
+
+uint64_t ChainTable::mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+
+size_t ChainTable::shard_of(const MAC& src_mac) const {
+    return mix( src_mac.to_u64() ) % shards_.size();
+}
+
+
+size_t ChainTable::shards() const {
+    return shards_.size();
+}
+
+
+void ChainTable::remove(Shard &sh, ChainState *slot) {
+    const uint64_t key = slot->key.load(std::memory_order_relaxed);
+    size_t i = slot - sh.slots;
+
+    if(slot->device != CHAIN_EMPTY) {
+        auto it = devices.find(slot->device);
+        if( it != devices.end() && it->second == key ) {
+            devices.erase(it);
+        }
+        slot->device = CHAIN_EMPTY;
+    }
+
+    slot->key.store(CHAIN_ERASED, std::memory_order_release);
+    sh.used.fetch_sub(1, std::memory_order_relaxed);
+    sh.erased++;
+
+    // Erased slots right before a free one end no probe sequence, free them as well
+    if( sh.slots[(i + 1) & sh.mask].key.load(std::memory_order_relaxed) == CHAIN_EMPTY ) {
+        while( sh.slots[i].key.load(std::memory_order_relaxed) == CHAIN_ERASED ) {
+            sh.slots[i].key.store(CHAIN_EMPTY, std::memory_order_release);
+            sh.erased--;
+            i = (i - 1) & sh.mask;
+        }
+    }
+
+    if( sh.erased * 4 > sh.mask + 1 ) {
+        compact(sh);
+    }
+}
+
+
+void ChainTable::compact(Shard &sh) {
+    typedef struct Live {
+        uint64_t key;
+        uint8_t hk_mac[32];
+        uint8_t k[4];
+        uint32_t seen_ms;
+        uint64_t device;
+    } Live;
+    std::vector<Live> live;
+
+    live.reserve( sh.used.load(std::memory_order_relaxed) );
+    for(size_t i=0; i<=sh.mask; ++i) {
+        ChainState &c = sh.slots[i];
+        const uint64_t key = c.key.load(std::memory_order_relaxed);
+        if(key != CHAIN_EMPTY && key != CHAIN_ERASED) {
+            live.emplace_back();
+            live.back().key = key;
+            memcpy(live.back().hk_mac, c.hk_mac, sizeof(c.hk_mac));
+            memcpy(live.back().k, c.k, sizeof(c.k));
+            live.back().seen_ms = c.seen_ms;
+            live.back().device = c.device;
+        }
+        c.key.store(CHAIN_EMPTY, std::memory_order_relaxed);
+    }
+
+    for(const Live &l : live) {
+        size_t i = (mix(l.key) / shards_.size()) & sh.mask;
+        while( sh.slots[i].key.load(std::memory_order_relaxed) != CHAIN_EMPTY ) {
+            i = (i + 1) & sh.mask;
+        }
+        ChainState &c = sh.slots[i];
+        memcpy(c.hk_mac, l.hk_mac, sizeof(c.hk_mac));
+        memcpy(c.k, l.k, sizeof(c.k));
+        c.seen_ms = l.seen_ms;
+        c.device = l.device;
+        c.key.store(l.key, std::memory_order_release);
+    }
+    sh.erased = 0;
+}
+
+
+ChainState* ChainTable::insert(const MAC& src_mac, const uint8_t *k, const MAC *device, uint32_t now_ms) {
+    const uint64_t key = src_mac.to_u64();
+    const uint64_t dev = device != NULL ? device->to_u64() : CHAIN_EMPTY;
+
+    // The device moved on to this identity, its earlier flow ends. Done first, as
+    // removing may move the slots of the shard.
+    if(device != NULL) {
+        auto it = devices.find(dev);
+        if( it != devices.end() && it->second != key ) {
+            MAC old;
+            memcpy(old.bytes, &it->second, sizeof(old.bytes));     // Inverse of MAC::to_u64()
+            erase(old);
+        }
+    }
+
+    const uint64_t h = mix(key);
+    Shard &sh = shards_[h % shards_.size()];
+    ChainState *slot = NULL, *free_slot = NULL;
+    size_t i = (h / shards_.size()) & sh.mask;
+
+    for(size_t n=0; n<=sh.mask; ++n, i=(i+1) & sh.mask) {
+        const uint64_t cur = sh.slots[i].key.load(std::memory_order_relaxed);
+        if(cur == key) {
+            slot = &sh.slots[i];
+            break;
+        }
+        if(cur == CHAIN_ERASED && free_slot == NULL) {
+            free_slot = &sh.slots[i];
+        }
+        if(cur == CHAIN_EMPTY) {
+            if(free_slot == NULL) {
+                free_slot = &sh.slots[i];
+            }
+            break;
+        }
+    }
+
+    if(slot == NULL) {
+        if(free_slot == NULL) {
+            return NULL;
+        }
+        slot = free_slot;
+        if( slot->key.load(std::memory_order_relaxed) == CHAIN_ERASED ) {
+            sh.erased--;
+        }
+        sh.used.fetch_add(1, std::memory_order_relaxed);
+    } else if( slot->device != CHAIN_EMPTY && slot->device != dev ) {
+        // Same identity, other device
+        auto it = devices.find(slot->device);
+        if( it != devices.end() && it->second == key ) {
+            devices.erase(it);
+        }
+    }
+
+    memset(slot->hk_mac, 0, sizeof(slot->hk_mac));
+    memcpy(slot->k, k, sizeof(slot->k));
+    slot->seen_ms = now_ms;
+    slot->device = dev;
+    slot->key.store(key, std::memory_order_release);
+    if(device != NULL) {
+        devices[dev] = key;
+    }
+    return slot;
+}
+
+
+ChainState* ChainTable::find(const MAC& src_mac) {
+    const uint64_t key = src_mac.to_u64();
+    const uint64_t h = mix(key);
+    Shard &sh = shards_[h % shards_.size()];
+    size_t i = (h / shards_.size()) & sh.mask;
+
+    for(size_t n=0; n<=sh.mask; ++n, i=(i+1) & sh.mask) {
+        const uint64_t cur = sh.slots[i].key.load(std::memory_order_acquire);
+        if(cur == key) {
+            return &sh.slots[i];
+        }
+        if(cur == CHAIN_EMPTY) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+
+void ChainTable::erase(const MAC& src_mac) {
+    ChainState *slot = find(src_mac);
+    if(slot != NULL) {
+        remove(shards_[shard_of(src_mac)], slot);
+    }
+}
+
+
+size_t ChainTable::size() const {
+    size_t n = 0;
+    for(const Shard &sh : shards_) {
+        n += sh.used.load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+
+};  // namespace puf
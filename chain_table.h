@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+#include "packets.h"
+
+namespace puf {
+
+
+/**
+ * Hash chain state of a single flow, i.e. of a connected supplicant. Every state
+ * takes a cache line of its own so that threads validating different flows do not
+ * share lines.
+*/
+typedef struct alignas(64) ChainState {
+    std::atomic<uint64_t> key;  // Source MAC of the flow or one of the markers of ChainTable
+    uint8_t hk_mac[32];         // Last value of the hash chain
+    uint8_t k[4];               // 4 bytes of the shared secret k
+    uint32_t seen_ms;           // Time of the handshake or of the last valid frame
+    uint64_t device;            // Base MAC of the supplicant, ~0 if unknown
+
+    ChainState();
+} ChainState;
+
+
+/**
+ * Table of the hash chain states of all flows keyed by source MAC, used by
+ * Authenticator::validate(). The table is split into shards by a hash of the MAC,
+ * each shard is an open addressing table with linear probing.
+ *
+ * No operation takes a lock. find() and the updates of the states it returns may
+ * run concurrently from any number of threads for different flows, e.g. from the
+ * workers owning shard_of() their flows. insert() and erase() reuse and move slots,
+ * so they must not run concurrently with any other operation, and a ChainState*
+ * is only valid until the next insert() or erase().
+ *
+ * A flow knows the device it belongs to, so the flow of a device's earlier identity
+ * ends when the device connects under the next one. Erased slots are reclaimed
+ * once they take a quarter of a shard, so lookups of unknown MACs stay short.
+*/
+class ChainTable {
+private:
+    typedef struct alignas(64) Shard {
+        ChainState *slots;
+        size_t mask;
+        std::atomic<size_t> used;
+        size_t erased;
+    } Shard;
+
+    std::vector<Shard> shards_;
+    std::unordered_map<uint64_t, uint64_t> devices;     // Base MAC -> source MAC of its latest flow
+
+    ChainTable(const ChainTable&) = delete;
+    ChainTable& operator=(const ChainTable&) = delete;
+
+    static uint64_t mix(uint64_t key);
+    void remove(Shard &sh, ChainState *slot);
+    void compact(Shard &sh);
+
+public:
+    /**
+     * @param capacity Number of flows to hold. Defaults to MAX_SESSIONS
+     * @param shards Number of shards. Defaults to CHAIN_TABLE_SHARDS
+    */
+    ChainTable(size_t capacity = MAX_SESSIONS, size_t shards = CHAIN_TABLE_SHARDS);
+    ~ChainTable();
+
+    /**
+     * @return The shard of a flow, in [0, shards())
+    */
+    size_t shard_of(const MAC& src_mac) const;
+    size_t shards() const;
+
+    /**
+     * Starts a new hash chain for a flow, replacing an existing one
+     * @param src_mac The (hashed) source MAC of the flow
+     * @param k 4 bytes of the shared secret k
+     * @param device Base MAC of the supplicant, its flow under another identity is
+     *               erased. NULL if unknown
+     * @param now_ms Current time in ms, see SessionTable::expire()
+     * @return The state or NULL if the shard is full
+    */
+    ChainState* insert(const MAC& src_mac, const uint8_t *k, const MAC *device = NULL, uint32_t now_ms = 0);
+
+    /**
+     * Looks up the hash chain of a flow
+     * @param src_mac The (hashed) source MAC of the flow
+     * @return The state or NULL if there is none
+    */
+    ChainState* find(const MAC& src_mac);
+
+    /**
+     * Removes the hash chain of a flow, if any
+     * @param src_mac The (hashed) source MAC of the flow
+    */
+    void erase(const MAC& src_mac);
+
+    size_t size() const;
+};
+
+
+};  // namespace puf
@@ -0,0 +1,535 @@
+#include "ecp_arith.h"
+#include "errors.h"
+#include "math.h"
+
+#include <vector>
+
+
+namespace puf {
+
+#if MBEDTLS_VERSION_MAJOR >= 3
+#define MODP(grp) ((grp).private_modp)
+#else
+#define MODP(grp) ((grp).modp)
+#endif
+
+
+ECP_Arith::ECP_Arith(const mbedtls_ecp_group &grp) : grp(grp) {
+    mbedtls_mpi_init(&T1);
+    mbedtls_mpi_init(&T2);
+    mbedtls_mpi_init(&T3);
+    mbedtls_mpi_init(&T4);
+    mbedtls_mpi_init(&T5);
+    mbedtls_mpi_init(&T6);
+
+    // Only the A = -3 shortcut is implemented, mbedtls leaves A empty in that case
+    if( MPI_P(&grp.A) != NULL ) {
+        throw MathException(MBEDTLS_ERR_ECP_FEATURE_UNAVAILABLE);
+    }
+}
+
+
+ECP_Arith::~ECP_Arith() {
+    mbedtls_mpi_free(&T1);
+    mbedtls_mpi_free(&T2);
+    mbedtls_mpi_free(&T3);
+    mbedtls_mpi_free(&T4);
+    mbedtls_mpi_free(&T5);
+    mbedtls_mpi_free(&T6);
+}
+
+
+void ECP_Arith::mod(mbedtls_mpi *N) const {
+    // Generic reduction if mbedtls has no fast reduction for this curve
+    if( MODP(grp) == NULL ) {
+        MATH_CHK( mbedtls_mpi_mod_mpi(N, N, &grp.P) );
+        return;
+    }
+
+    MATH_CHK( MODP(grp)(N) );
+    while( MPI_S(N) < 0 && mbedtls_mpi_cmp_int(N, 0) != 0 ) {
+        MATH_CHK( mbedtls_mpi_add_mpi(N, N, &grp.P) );
+    }
+    while( mbedtls_mpi_cmp_mpi(N, &grp.P) >= 0 ) {
+        MATH_CHK( mbedtls_mpi_sub_abs(N, N, &grp.P) );
+    }
+}
+
+
+void ECP_Arith::mul_mod(mbedtls_mpi *X, const mbedtls_mpi *A, const mbedtls_mpi *B) const {
+    MATH_CHK( mbedtls_mpi_mul_mpi(X, A, B) );
+    mod(X);
+}
+
+
+void ECP_Arith::add_mod(mbedtls_mpi *X, const mbedtls_mpi *A, const mbedtls_mpi *B) const {
+    MATH_CHK( mbedtls_mpi_add_mpi(X, A, B) );
+    while( mbedtls_mpi_cmp_mpi(X, &grp.P) >= 0 ) {
+        MATH_CHK( mbedtls_mpi_sub_abs(X, X, &grp.P) );
+    }
+}
+
+
+void ECP_Arith::sub_mod(mbedtls_mpi *X, const mbedtls_mpi *A, const mbedtls_mpi *B) const {
+    MATH_CHK( mbedtls_mpi_sub_mpi(X, A, B) );
+    while( MPI_S(X) < 0 && mbedtls_mpi_cmp_int(X, 0) != 0 ) {
+        MATH_CHK( mbedtls_mpi_add_mpi(X, X, &grp.P) );
+    }
+}
+
+
+void ECP_Arith::shl_mod(mbedtls_mpi *X, size_t count) const {
+    MATH_CHK( mbedtls_mpi_shift_l(X, count) );
+    while( mbedtls_mpi_cmp_mpi(X, &grp.P) >= 0 ) {
+        MATH_CHK( mbedtls_mpi_sub_abs(X, X, &grp.P) );
+    }
+}
+
+
+/* dbl-1998-cmo-2 with A = -3, as in mbedtls ecp_double_jac() */
+void ECP_Arith::dbl(mbedtls_ecp_point *R, const mbedtls_ecp_point *P) {
+    // M = 3(X + Z^2)(X - Z^2)
+    mul_mod(&T2, ECP_Z(P), ECP_Z(P));
+    add_mod(&T3, ECP_X(P), &T2);
+    sub_mod(&T4, ECP_X(P), &T2);
+    mul_mod(&T2, &T3, &T4);
+    MATH_CHK( mbedtls_mpi_mul_int(&T1, &T2, 3) );
+    while( mbedtls_mpi_cmp_mpi(&T1, &grp.P) >= 0 ) {
+        MATH_CHK( mbedtls_mpi_sub_abs(&T1, &T1, &grp.P) );
+    }
+
+    // S = 4XY^2
+    mul_mod(&T3, ECP_Y(P), ECP_Y(P));
+    shl_mod(&T3, 1);
+    mul_mod(&T2, ECP_X(P), &T3);
+    shl_mod(&T2, 1);
+
+    // U = 8Y^4
+    mul_mod(&T4, &T3, &T3);
+    shl_mod(&T4, 1);
+
+    // T = M^2 - 2S
+    mul_mod(&T3, &T1, &T1);
+    sub_mod(&T3, &T3, &T2);
+    sub_mod(&T3, &T3, &T2);
+
+    // S = M(S - T) - U
+    sub_mod(&T2, &T2, &T3);
+    mul_mod(&T2, &T2, &T1);
+    sub_mod(&T2, &T2, &T4);
+
+    // U = 2YZ
+    mul_mod(&T4, ECP_Y(P), ECP_Z(P));
+    shl_mod(&T4, 1);
+
+    MATH_CHK( mbedtls_mpi_copy(ECP_X(R), &T3) );
+    MATH_CHK( mbedtls_mpi_copy(ECP_Y(R), &T2) );
+    MATH_CHK( mbedtls_mpi_copy(ECP_Z(R), &T4) );
+}
+
+
+/* Cohen et al. mixed addition, as in mbedtls ecp_add_mixed() */
+void ECP_Arith::add_mixed(mbedtls_ecp_point *R, const mbedtls_ecp_point *P, const mbedtls_ecp_point *Q) {
+    // Trivial cases: P == 0 or Q == 0
+    if( mbedtls_mpi_cmp_int(ECP_Z(P), 0) == 0 ) {
+        MATH_CHK( mbedtls_ecp_copy(R, Q) );
+        return;
+    }
+    if( mbedtls_mpi_cmp_int(ECP_Z(Q), 0) == 0 ) {
+        MATH_CHK( mbedtls_ecp_copy(R, P) );
+        return;
+    }
+
+    mul_mod(&T1, ECP_Z(P), ECP_Z(P));
+    mul_mod(&T2, &T1, ECP_Z(P));
+    mul_mod(&T1, &T1, ECP_X(Q));
+    mul_mod(&T2, &T2, ECP_Y(Q));
+    sub_mod(&T1, &T1, ECP_X(P));
+    sub_mod(&T2, &T2, ECP_Y(P));
+
+    // P == Q or P == -Q
+    if( mbedtls_mpi_cmp_int(&T1, 0) == 0 ) {
+        if( mbedtls_mpi_cmp_int(&T2, 0) == 0 ) {
+            dbl(R, P);
+        } else {
+            MATH_CHK( mbedtls_ecp_set_zero(R) );
+        }
+        return;
+    }
+
+    // Z of P and Q is not used anymore, R may alias them
+    mul_mod(ECP_Z(R), ECP_Z(P), &T1);
+    mul_mod(&T3, &T1, &T1);
+    mul_mod(&T4, &T3, &T1);
+    mul_mod(&T3, &T3, ECP_X(P));
+    MATH_CHK( mbedtls_mpi_copy(&T1, &T3) );
+    shl_mod(&T1, 1);
+    mul_mod(&T5, &T2, &T2);
+    sub_mod(&T5, &T5, &T1);
+    sub_mod(&T5, &T5, &T4);
+    sub_mod(&T3, &T3, &T5);
+    mul_mod(&T3, &T3, &T2);
+    mul_mod(&T4, &T4, ECP_Y(P));
+    sub_mod(&T6, &T3, &T4);
+
+    MATH_CHK( mbedtls_mpi_copy(ECP_X(R), &T5) );
+    MATH_CHK( mbedtls_mpi_copy(ECP_Y(R), &T6) );
+}
+
+
+/* add-1998-cmo-2 */
+void ECP_Arith::add(mbedtls_ecp_point *R, const mbedtls_ecp_point *P, const mbedtls_ecp_point *Q) {
+    // Trivial cases: P == 0 or Q == 0
+    if( mbedtls_mpi_cmp_int(ECP_Z(P), 0) == 0 ) {
+        MATH_CHK( mbedtls_ecp_copy(R, Q) );
+        return;
+    }
+    if( mbedtls_mpi_cmp_int(ECP_Z(Q), 0) == 0 ) {
+        MATH_CHK( mbedtls_ecp_copy(R, P) );
+        return;
+    }
+
+    mul_mod(&T1, ECP_Z(Q), ECP_Z(Q));       // Z2^2
+    mul_mod(&T2, ECP_Z(P), ECP_Z(P));       // Z1^2
+    mul_mod(&T3, ECP_X(P), &T1);            // U1 = X1 Z2^2
+    mul_mod(&T4, ECP_X(Q), &T2);
+    sub_mod(&T4, &T4, &T3);                 // H = U2 - U1
+    mul_mod(&T1, &T1, ECP_Z(Q));
+    mul_mod(&T1, &T1, ECP_Y(P));            // S1 = Y1 Z2^3
+    mul_mod(&T2, &T2, ECP_Z(P));
+    mul_mod(&T2, &T2, ECP_Y(Q));
+    sub_mod(&T2, &T2, &T1);                 // r = S2 - S1
+
+    // P == Q or P == -Q
+    if( mbedtls_mpi_cmp_int(&T4, 0) == 0 ) {
+        if( mbedtls_mpi_cmp_int(&T2, 0) == 0 ) {
+            dbl(R, P);
+        } else {
+            MATH_CHK( mbedtls_ecp_set_zero(R) );
+        }
+        return;
+    }
+
+    mul_mod(&T6, ECP_Z(P), ECP_Z(Q));
+    mul_mod(&T6, &T6, &T4);                 // Z3 = Z1 Z2 H
+    mul_mod(&T5, &T4, &T4);                 // H^2
+    mul_mod(&T4, &T5, &T4);                 // H^3
+    mul_mod(&T5, &T3, &T5);                 // U1 H^2
+
+    mul_mod(&T3, &T2, &T2);
+    sub_mod(&T3, &T3, &T4);
+    sub_mod(&T3, &T3, &T5);
+    sub_mod(&T3, &T3, &T5);                 // X3 = r^2 - H^3 - 2 U1 H^2
+
+    sub_mod(&T5, &T5, &T3);
+    mul_mod(&T5, &T5, &T2);
+    mul_mod(&T4, &T4, &T1);
+    sub_mod(&T5, &T5, &T4);                 // Y3 = r (U1 H^2 - X3) - S1 H^3
+
+    MATH_CHK( mbedtls_mpi_copy(ECP_X(R), &T3) );
+    MATH_CHK( mbedtls_mpi_copy(ECP_Y(R), &T5) );
+    MATH_CHK( mbedtls_mpi_copy(ECP_Z(R), &T6) );
+}
+
+
+void ECP_Arith::neg(mbedtls_ecp_point *R, const mbedtls_ecp_point *P) const {
+    if( R != P ) {
+        MATH_CHK( mbedtls_ecp_copy(R, P) );
+    }
+    if( mbedtls_mpi_cmp_int(ECP_Y(R), 0) != 0 ) {
+        MATH_CHK( mbedtls_mpi_sub_mpi(ECP_Y(R), &grp.P, ECP_Y(R)) );
+    }
+}
+
+
+bool ECP_Arith::equal(const mbedtls_ecp_point *P, const mbedtls_ecp_point *Q) {
+    const bool p_zero = mbedtls_mpi_cmp_int(ECP_Z(P), 0) == 0;
+    const bool q_zero = mbedtls_mpi_cmp_int(ECP_Z(Q), 0) == 0;
+
+    if( p_zero || q_zero ) {
+        return p_zero == q_zero;
+    }
+
+    // X1 Z2^2 == X2 Z1^2
+    mul_mod(&T1, ECP_Z(Q), ECP_Z(Q));
+    mul_mod(&T2, ECP_Z(P), ECP_Z(P));
+    mul_mod(&T3, ECP_X(P), &T1);
+    mul_mod(&T4, ECP_X(Q), &T2);
+    if( mbedtls_mpi_cmp_mpi(&T3, &T4) != 0 ) {
+        return false;
+    }
+
+    // Y1 Z2^3 == Y2 Z1^3
+    mul_mod(&T1, &T1, ECP_Z(Q));
+    mul_mod(&T2, &T2, ECP_Z(P));
+    mul_mod(&T3, ECP_Y(P), &T1);
+    mul_mod(&T4, ECP_Y(Q), &T2);
+    return mbedtls_mpi_cmp_mpi(&T3, &T4) == 0;
+}
+
+
+void ECP_Arith::normalize(mbedtls_ecp_point *P) {
+    if( mbedtls_mpi_cmp_int(ECP_Z(P), 0) == 0 || mbedtls_mpi_cmp_int(ECP_Z(P), 1) == 0 ) {
+        return;
+    }
+
+    // X = X/Z^2, Y = Y/Z^3
+    MATH_CHK( mbedtls_mpi_inv_mod(&T1, ECP_Z(P), &grp.P) );
+    mul_mod(&T2, &T1, &T1);
+    mul_mod(ECP_X(P), ECP_X(P), &T2);
+    mul_mod(ECP_Y(P), ECP_Y(P), &T2);
+    mul_mod(ECP_Y(P), ECP_Y(P), &T1);
+    MATH_CHK( mbedtls_mpi_lset(ECP_Z(P), 1) );
+}
+
+
+/* Montgomery's trick: invert the product of all Z and unwind */
+void ECP_Arith::normalize_many(mbedtls_ecp_point *T[], size_t n) {
+    std::vector<mbedtls_mpi> c(n);
+    size_t i;
+
+    if( n == 0 ) {
+        return;
+    }
+    if( n == 1 ) {
+        normalize(T[0]);
+        return;
+    }
+
+    for(i=0; i<n; ++i) {
+        mbedtls_mpi_init(&c[i]);
+    }
+
+    try {
+        // c[i] = Z_0 * ... * Z_i, points at infinity are skipped
+        for(i=0; i<n; ++i) {
+            const mbedtls_mpi *z = ECP_Z(T[i]);
+            if( mbedtls_mpi_cmp_int(z, 0) == 0 ) {
+                MATH_CHK( mbedtls_mpi_lset(&T4, 1) );
+                z = &T4;
+            }
+
+            if( i == 0 ) {
+                MATH_CHK( mbedtls_mpi_copy(&c[0], z) );
+            } else {
+                mul_mod(&c[i], &c[i-1], z);
+            }
+        }
+
+        // T1 = 1 / (Z_0 * ... * Z_(n-1))
+        MATH_CHK( mbedtls_mpi_inv_mod(&T1, &c[n-1], &grp.P) );
+
+        for(i=n; i-- > 0; ) {
+            if( mbedtls_mpi_cmp_int(ECP_Z(T[i]), 0) == 0 ) {
+                continue;
+            }
+
+            // T2 = 1/Z_i, T1 = 1 / (Z_0 * ... * Z_(i-1))
+            if( i == 0 ) {
+                MATH_CHK( mbedtls_mpi_copy(&T2, &T1) );
+            } else {
+                mul_mod(&T2, &T1, &c[i-1]);
+                mul_mod(&T1, &T1, ECP_Z(T[i]));
+            }
+
+            mul_mod(&T3, &T2, &T2);
+            mul_mod(ECP_X(T[i]), ECP_X(T[i]), &T3);
+            mul_mod(ECP_Y(T[i]), ECP_Y(T[i]), &T3);
+            mul_mod(ECP_Y(T[i]), ECP_Y(T[i]), &T2);
+            MATH_CHK( mbedtls_mpi_lset(ECP_Z(T[i]), 1) );
+        }
+    } catch(const MathException &e) {
+        for(i=0; i<n; ++i) {
+            mbedtls_mpi_free(&c[i]);
+        }
+        throw;
+    }
+
+    for(i=0; i<n; ++i) {
+        mbedtls_mpi_free(&c[i]);
+    }
+}
+
+
+void ECP_Arith::wnaf(std::vector<int8_t> &naf, const mbedtls_mpi *m, unsigned w) {
+    const mbedtls_mpi_sint width = static_cast<mbedtls_mpi_sint>(1) << w;
+    MPI k(*m);
+    MPI_S(&k) = 1;
+
+    naf.clear();
+    while( mbedtls_mpi_cmp_int(&k, 0) != 0 ) {
+        mbedtls_mpi_sint digit = 0;
+
+        // Odd: take the signed residue mod 2^w, leaving w-1 zeros behind it
+        if( mbedtls_mpi_get_bit(&k, 0) ) {
+            digit = static_cast<mbedtls_mpi_sint>( MPI_P(&k)[0] & (width - 1) );
+            if( digit >= width/2 ) {
+                digit -= width;
+            }
+            MATH_CHK( mbedtls_mpi_sub_int(&k, &k, digit) );
+        }
+
+        naf.push_back( static_cast<int8_t>(digit) );
+        MATH_CHK( mbedtls_mpi_shift_r(&k, 1) );
+    }
+}
+
+
+/* Straus' interleaving with a wNAF and a table of odd multiples per point */
+void ECP_Arith::muladd_vartime(mbedtls_ecp_point *R, const mbedtls_mpi *const m[], 
+    const mbedtls_ecp_point *const P[], size_t n) 
+{
+    std::vector< std::vector<int8_t> > naf(n);
+    std::vector<size_t> offset(n+1, 0);
+    size_t len = 0;
+    size_t i, j;
+
+    // Window width by scalar length, short scalars do not pay for big tables
+    for(i=0; i<n; ++i) {
+        const size_t bits = mbedtls_mpi_bitlen(m[i]);
+        const unsigned w = bits > 128 ? 5 : bits > 16 ? 4 : bits > 4 ? 3 : 2;
+        wnaf(naf[i], m[i], w);
+        offset[i+1] = offset[i] + (1u << (w-2));
+        len = naf[i].size() > len ? naf[i].size() : len;
+    }
+
+    ECP_PointVec table(offset[n] + 2);
+    mbedtls_ecp_point *acc = &table[offset[n]];
+    mbedtls_ecp_point *tmp = &table[offset[n] + 1];
+
+    // table[offset[i] + j] = (2j+1) P_i, negated for negative scalars
+    for(i=0; i<n; ++i) {
+        mbedtls_ecp_point *T = &table[offset[i]];
+
+        if( MPI_S(m[i]) < 0 ) {
+            neg(&T[0], P[i]);
+        } else {
+            MATH_CHK( mbedtls_ecp_copy(&T[0], P[i]) );
+        }
+        if( offset[i+1] - offset[i] > 1 ) {
+            dbl(tmp, &T[0]);
+            for(j=1; j<offset[i+1]-offset[i]; ++j) {
+                add(&T[j], &T[j-1], tmp);
+            }
+        }
+    }
+
+    MATH_CHK( mbedtls_ecp_set_zero(acc) );
+    for(size_t bit=len; bit-- > 0; ) {
+        if( mbedtls_mpi_cmp_int(ECP_Z(acc), 0) != 0 ) {
+            dbl(acc, acc);
+        }
+
+        for(i=0; i<n; ++i) {
+            if( bit >= naf[i].size() || naf[i][bit] == 0 ) {
+                continue;
+            }
+
+            const int8_t digit = naf[i][bit];
+            const mbedtls_ecp_point *T = &table[ offset[i] + (digit > 0 ? digit : -digit) / 2 ];
+            if( digit > 0 ) {
+                add(acc, acc, T);
+            } else {
+                neg(tmp, T);
+                add(acc, acc, tmp);
+            }
+        }
+    }
+
+    MATH_CHK( mbedtls_ecp_copy(R, acc) );
+}
+
+
+void ECP_Arith::msm_vartime(mbedtls_ecp_point *R, const mbedtls_mpi *const m[], 
+    const mbedtls_ecp_point *const P[], size_t n)
+{
+    size_t bits = 0;
+    size_t i;
+
+    // Straus is cheaper while the tables are smaller than the buckets
+    if( n < 64 ) {
+        muladd_vartime(R, m, P, n);
+        return;
+    }
+
+    for(i=0; i<n; ++i) {
+        if( MPI_S(m[i]) < 0 ) {
+            throw MathException(MBEDTLS_ERR_ECP_BAD_INPUT_DATA);
+        }
+        const size_t b = mbedtls_mpi_bitlen(m[i]);
+        bits = b > bits ? b : bits;
+    }
+
+    // Window of c bits, about log2(n) - 2 minimises c-bit windows * (n + 2^c) additions
+    unsigned c = 0;
+    while( (static_cast<size_t>(1) << (c+1)) <= n ) {
+        c++;
+    }
+    c = c - 2 > 12 ? 12 : c - 2;
+
+    const size_t windows = (bits + c - 1) / c;
+    const size_t nbuckets = (static_cast<size_t>(1) << c) - 1;
+    ECP_PointVec buckets(nbuckets + 3);
+    mbedtls_ecp_point *acc = &buckets[nbuckets];
+    mbedtls_ecp_point *running = &buckets[nbuckets + 1];
+    mbedtls_ecp_point *sum = &buckets[nbuckets + 2];
+
+    MATH_CHK( mbedtls_ecp_set_zero(acc) );
+    for(size_t win=windows; win-- > 0; ) {
+        if( mbedtls_mpi_cmp_int(ECP_Z(acc), 0) != 0 ) {
+            for(unsigned j=0; j<c; ++j) {
+                dbl(acc, acc);
+            }
+        }
+
+        for(size_t b=0; b<nbuckets; ++b) {
+            MATH_CHK( mbedtls_ecp_set_zero(&buckets[b]) );
+        }
+
+        // Sort points into the bucket of their digit
+        for(i=0; i<n; ++i) {
+            size_t digit = 0;
+            for(unsigned j=0; j<c; ++j) {
+                digit |= static_cast<size_t>( mbedtls_mpi_get_bit(m[i], win*c + j) ) << j;
+            }
+            if( digit == 0 ) {
+                continue;
+            }
+
+            if( mbedtls_mpi_cmp_int(ECP_Z(P[i]), 1) == 0 ) {
+                add_mixed(&buckets[digit-1], &buckets[digit-1], P[i]);
+            } else {
+                add(&buckets[digit-1], &buckets[digit-1], P[i]);
+            }
+        }
+
+        // sum = 1*B_1 + 2*B_2 + ... by running sums from the top
+        MATH_CHK( mbedtls_ecp_set_zero(running) );
+        MATH_CHK( mbedtls_ecp_set_zero(sum) );
+        for(size_t b=nbuckets; b-- > 0; ) {
+            add(running, running, &buckets[b]);
+            add(sum, sum, running);
+        }
+
+        add(acc, acc, sum);
+    }
+
+    MATH_CHK( mbedtls_ecp_copy(R, acc) );
+}
+
+
+ECP_PointVec::ECP_PointVec(size_t n) : points(n) {
+    for(size_t i=0; i<n; ++i) {
+        mbedtls_ecp_point_init(&points[i]);
+    }
+}
+
+
+ECP_PointVec::~ECP_PointVec() {
+    for(size_t i=0; i<points.size(); ++i) {
+        mbedtls_ecp_point_free(&points[i]);
+    }
+}
+
+
+};  // namespace puf
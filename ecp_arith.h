@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vector>
+#include <mbedtls/ecp.h>
+
+/* Access to the coordinates and limbs across mbedtls versions */
+#if MBEDTLS_VERSION_MAJOR >= 3
+#define ECP_X(pt) (&(pt)->private_X)
+#define ECP_Y(pt) (&(pt)->private_Y)
+#define ECP_Z(pt) (&(pt)->private_Z)
+#define MPI_S(X) ((X)->private_s)
+#define MPI_N(X) ((X)->private_n)
+#define MPI_P(X) ((X)->private_p)
+#else
+#define ECP_X(pt) (&(pt)->X)
+#define ECP_Y(pt) (&(pt)->Y)
+#define ECP_Z(pt) (&(pt)->Z)
+#define MPI_S(X) ((X)->s)
+#define MPI_N(X) ((X)->n)
+#define MPI_P(X) ((X)->p)
+#endif
+
+namespace puf {
+
+
+/**
+ * Owning array of initialised mbedtls_ecp_points
+*/
+class ECP_PointVec {
+private:
+    std::vector<mbedtls_ecp_point> points;
+
+    ECP_PointVec(const ECP_PointVec&) = delete;
+    ECP_PointVec& operator=(const ECP_PointVec&) = delete;
+
+public:
+    ECP_PointVec(size_t n);
+    ~ECP_PointVec();
+
+    size_t size() const {return points.size();}
+    mbedtls_ecp_point& operator[](size_t i) {return points[i];}
+    mbedtls_ecp_point* data() {return points.data();}
+};
+
+
+/**
+ * Field and Jacobian point arithmetic on top of mbedtls_mpi for curves with
+ * A = -3 (e.g. secp256r1). Used where mbedtls_ecp_mul() does not fit, i.e.
+ * precomputed tables and multi-scalar multiplications. Points are
+ * mbedtls_ecp_points in Jacobian coordinates, Z = 0 being the point at
+ * infinity. Holds scratch registers, so an instance must not be shared
+ * between threads.
+*/
+class ECP_Arith {
+private:
+    const mbedtls_ecp_group &grp;
+    mbedtls_mpi T1, T2, T3, T4, T5, T6;
+
+    ECP_Arith(const ECP_Arith&) = delete;
+    ECP_Arith& operator=(const ECP_Arith&) = delete;
+
+public:
+    ECP_Arith(const mbedtls_ecp_group &grp);
+    ~ECP_Arith();
+
+    const mbedtls_ecp_group& group() const {return grp;}
+
+    // Field arithmetic modulo P, operands must be reduced
+    void mod(mbedtls_mpi *N) const;
+    void mul_mod(mbedtls_mpi *X, const mbedtls_mpi *A, const mbedtls_mpi *B) const;
+    void add_mod(mbedtls_mpi *X, const mbedtls_mpi *A, const mbedtls_mpi *B) const;
+    void sub_mod(mbedtls_mpi *X, const mbedtls_mpi *A, const mbedtls_mpi *B) const;
+    void shl_mod(mbedtls_mpi *X, size_t count) const;
+
+    /**
+     * R = 2P
+    */
+    void dbl(mbedtls_ecp_point *R, const mbedtls_ecp_point *P);
+
+    /**
+     * R = P + Q with Q in affine coordinates (Z = 1)
+    */
+    void add_mixed(mbedtls_ecp_point *R, const mbedtls_ecp_point *P, const mbedtls_ecp_point *Q);
+
+    /**
+     * R = P + Q
+    */
+    void add(mbedtls_ecp_point *R, const mbedtls_ecp_point *P, const mbedtls_ecp_point *Q);
+
+    /**
+     * R = -P
+    */
+    void neg(mbedtls_ecp_point *R, const mbedtls_ecp_point *P) const;
+
+    /**
+     * Checks P == Q without converting to affine coordinates
+    */
+    bool equal(const mbedtls_ecp_point *P, const mbedtls_ecp_point *Q);
+
+    /**
+     * Converts P to affine coordinates
+    */
+    void normalize(mbedtls_ecp_point *P);
+
+    /**
+     * Converts n points to affine coordinates with a single inversion
+    */
+    void normalize_many(mbedtls_ecp_point *T[], size_t n);
+
+    /**
+     * Width-w non-adjacent form of |m|, least significant digit first. Non-zero
+     * digits are odd and in (-2^(w-1), 2^(w-1)).
+    */
+    static void wnaf(std::vector<int8_t> &naf, const mbedtls_mpi *m, unsigned w);
+
+    /**
+     * R = m[0]*P[0] + ... + m[n-1]*P[n-1] in Jacobian coordinates.
+     * Variable time, only for public scalars and points.
+    */
+    void muladd_vartime(mbedtls_ecp_point *R, const mbedtls_mpi *const m[], 
+        const mbedtls_ecp_point *const P[], size_t n);
+
+    /**
+     * Same as muladd_vartime() for many points, using Pippenger's bucket method
+     * once n is large enough. Scalars must not be negative, points should be
+     * affine.
+    */
+    void msm_vartime(mbedtls_ecp_point *R, const mbedtls_mpi *const m[], 
+        const mbedtls_ecp_point *const P[], size_t n);
+};
+
+
+};  // namespace puf
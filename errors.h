@@ -3,6 +3,9 @@
 #include <string.h>             // strncpy
 #include <mbedtls/error.h>      // mbedtls_strerror
 
+/* Throws a MathException if an mbedtls call fails */
+#define MATH_CHK(f) do { int err_ = (f); if(err_ != 0) throw puf::MathException(err_); } while(0)
+
 namespace puf {
 
 class Exception {
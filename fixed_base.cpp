@@ -0,0 +1,177 @@
+#include "fixed_base.h"
+#include "errors.h"
+
+#include <string.h>
+
+
+namespace puf {
+
+
+FixedBase::FixedBase(const mbedtls_ecp_group &grp, unsigned window_bits,
+                     const mbedtls_ecp_point *base, size_t scalar_bits) : 
+    arith(grp),
+    w(window_bits > 8 ? 8 : window_bits),
+    windows(0),
+    entries(0),
+    nlimbs(0)
+{
+    mbedtls_ecp_point_init(&B);
+
+    if( scalar_bits == 0 || scalar_bits > grp.nbits ) {
+        scalar_bits = grp.nbits;
+    }
+
+    MATH_CHK( mbedtls_ecp_copy(&B, base) );
+    arith.normalize(&B);
+
+    if(w > 0) {
+        windows = (scalar_bits + w - 1) / w;
+        entries = (1u << w) - 1;
+        nlimbs = (grp.pbits + 8*sizeof(mbedtls_mpi_uint) - 1) / (8*sizeof(mbedtls_mpi_uint));
+    }
+}
+
+
+FixedBase::~FixedBase() {
+    mbedtls_ecp_point_free(&B);
+}
+
+
+bool FixedBase::is_base(const mbedtls_ecp_point &P) const {
+    return mbedtls_mpi_cmp_int(ECP_Z(&P), 1) == 0 &&
+           mbedtls_mpi_cmp_mpi(ECP_X(&P), ECP_X(&B)) == 0 &&
+           mbedtls_mpi_cmp_mpi(ECP_Y(&P), ECP_Y(&B)) == 0;
+}
+
+
+size_t FixedBase::table_size() const {
+    return windows * entries * 2 * nlimbs * sizeof(mbedtls_mpi_uint);
+}
+
+
+void FixedBase::store(size_t window, unsigned digit, const mbedtls_ecp_point *P) {
+    mbedtls_mpi_uint *dst = &table[ (window*entries + digit-1) * 2 * nlimbs ];
+    size_t n;
+
+    memset(dst, 0, 2 * nlimbs * sizeof(mbedtls_mpi_uint));
+    n = MPI_N(ECP_X(P)) < nlimbs ? MPI_N(ECP_X(P)) : nlimbs;
+    memcpy(dst, MPI_P(ECP_X(P)), n * sizeof(mbedtls_mpi_uint));
+    n = MPI_N(ECP_Y(P)) < nlimbs ? MPI_N(ECP_Y(P)) : nlimbs;
+    memcpy(dst + nlimbs, MPI_P(ECP_Y(P)), n * sizeof(mbedtls_mpi_uint));
+}
+
+
+void FixedBase::load(mbedtls_ecp_point *P, size_t window, unsigned digit) {
+    const mbedtls_mpi_uint *src = &table[ (window*entries + digit-1) * 2 * nlimbs ];
+    mbedtls_mpi *coords[2] = { ECP_X(P), ECP_Y(P) };
+
+    for(int c=0; c<2; ++c) {
+        MATH_CHK( mbedtls_mpi_lset(coords[c], 0) );
+        MATH_CHK( mbedtls_mpi_grow(coords[c], nlimbs) );
+        memcpy(MPI_P(coords[c]), src + c*nlimbs, nlimbs * sizeof(mbedtls_mpi_uint));
+    }
+
+    MATH_CHK( mbedtls_mpi_lset(ECP_Z(P), 1) );
+}
+
+
+void FixedBase::build() {
+    std::vector<mbedtls_ecp_point> pts(windows * entries);
+    std::vector<mbedtls_ecp_point*> ptrs(windows * entries);
+    mbedtls_ecp_point Bi;
+    size_t i, j;
+
+    table.assign(windows * entries * 2 * nlimbs, 0);
+
+    mbedtls_ecp_point_init(&Bi);
+    for(i=0; i<pts.size(); ++i) {
+        mbedtls_ecp_point_init(&pts[i]);
+        ptrs[i] = &pts[i];
+    }
+
+    try {
+        MATH_CHK( mbedtls_ecp_copy(&Bi, &B) );
+
+        for(i=0; i<windows; ++i) {
+            mbedtls_ecp_point *row = &pts[i*entries];
+
+            // row[j-1] = j * 2^(w*i) * B, Bi stays Jacobian to avoid an inversion per window
+            MATH_CHK( mbedtls_ecp_copy(&row[0], &Bi) );
+            for(j=1; j<entries; ++j) {
+                if(i == 0) {
+                    arith.add_mixed(&row[j], &row[j-1], &Bi);
+                } else {
+                    arith.add(&row[j], &row[j-1], &Bi);
+                }
+            }
+
+            for(j=0; j<w; ++j) {
+                arith.dbl(&Bi, &Bi);
+            }
+        }
+
+        arith.normalize_many(ptrs.data(), ptrs.size());
+
+        for(i=0; i<windows; ++i) {
+            for(j=1; j<=entries; ++j) {
+                store(i, j, &pts[i*entries + j-1]);
+            }
+        }
+    } catch(const MathException &e) {
+        table.clear();
+        mbedtls_ecp_point_free(&Bi);
+        for(i=0; i<pts.size(); ++i) {
+            mbedtls_ecp_point_free(&pts[i]);
+        }
+        throw;
+    }
+
+    mbedtls_ecp_point_free(&Bi);
+    for(i=0; i<pts.size(); ++i) {
+        mbedtls_ecp_point_free(&pts[i]);
+    }
+}
+
+
+void FixedBase::build_once() {
+    // A failed build leaves the flag unset, so the next caller tries again
+    std::call_once(built, &FixedBase::build, this);
+}
+
+
+void FixedBase::muladd_vartime(mbedtls_ecp_point *R_, const mbedtls_mpi *m, const mbedtls_ecp_point *P,
+                               ECP_Arith &arith) {
+    ECP_PointVec scratch(2);
+    mbedtls_ecp_point &R = scratch[0], &Q = scratch[1];
+
+    if( !enabled() ) {
+        throw MathException(MBEDTLS_ERR_ECP_FEATURE_UNAVAILABLE);
+    }
+
+    if( mbedtls_mpi_cmp_int(m, 0) < 0 || mbedtls_mpi_bitlen(m) > scalar_bits() ) {
+        throw MathException(MBEDTLS_ERR_ECP_BAD_INPUT_DATA);
+    }
+
+    build_once();
+
+    MATH_CHK( mbedtls_ecp_copy(&R, P) );
+
+    // Skip zero digits and the windows above the length of m
+    const size_t used = (mbedtls_mpi_bitlen(m) + w - 1) / w;
+    for(size_t i=0; i<used; ++i) {
+        unsigned digit = 0;
+        for(unsigned b=0; b<w; ++b) {
+            digit |= static_cast<unsigned>( mbedtls_mpi_get_bit(m, i*w + b) ) << b;
+        }
+
+        if(digit != 0) {
+            load(&Q, i, digit);
+            arith.add_mixed(&R, &R, &Q);
+        }
+    }
+
+    MATH_CHK( mbedtls_ecp_copy(R_, &R) );
+}
+
+
+};  // namespace puf
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <mbedtls/ecp.h>
+
+#include "ecp_arith.h"
+
+namespace puf {
+
+
+/**
+ * Multiplication with a fixed base point B using precomputed tables, e.g. the
+ * public key A of a device, see KeyTableCache. Multiplications of the generator G
+ * are left to mbedtls_ecp_mul(), which keeps a comb table of G in the group.
+ *
+ * For a window width w the table holds j * 2^(w*i) * B for every window i and
+ * every digit j in [1, 2^w), so a multiplication needs no doublings and one
+ * mixed addition per nonzero window. Memory is ceil(bits/w) * (2^w - 1) affine
+ * points where bits is the maximum scalar length.
+ *
+ * muladd_vartime() does not run in constant time: it skips zero digits, indexes
+ * the table directly and the mbedtls_mpi arithmetic underneath depends on its
+ * operands. It is for public scalars only, e.g. the challenge d.
+ *
+ * The table is built once and only read afterwards, the multiplications work on
+ * the scratch of the caller. So one table may be used by any number of threads at
+ * once, each passing an ECP_Arith of its own, e.g. PUFStatics::ecp_arith().
+*/
+class FixedBase {
+private:
+    ECP_Arith arith;            // Scratch of the constructor and build()
+    unsigned w;
+    size_t windows;
+    size_t entries;
+    size_t nlimbs;
+    std::vector<mbedtls_mpi_uint> table;
+    std::once_flag built;
+    mbedtls_ecp_point B;
+
+    FixedBase(const FixedBase&) = delete;
+    FixedBase& operator=(const FixedBase&) = delete;
+
+    void build();
+    void build_once();
+    void store(size_t window, unsigned digit, const mbedtls_ecp_point *P);
+    void load(mbedtls_ecp_point *P, size_t window, unsigned digit);
+
+public:
+    /**
+     * @param grp The group, must outlive this object
+     * @param window_bits Window width w in [1, 8], 0 disables the table
+     * @param base Base point B
+     * @param scalar_bits Maximum length of scalars, nbits of the group if 0
+    */
+    FixedBase(const mbedtls_ecp_group &grp, unsigned window_bits,
+              const mbedtls_ecp_point *base, size_t scalar_bits = 0);
+    ~FixedBase();
+
+    bool enabled() const {return w > 0;}
+
+    /**
+     * Checks if P is the base point B
+    */
+    bool is_base(const mbedtls_ecp_point &P) const;
+
+    /**
+     * @return Maximum length in bits of scalars accepted by muladd_vartime()
+    */
+    size_t scalar_bits() const {return windows * w;}
+
+    /**
+     * R = m*B + P in variable time, only for public inputs. The table is built
+     * on first use.
+     * @param R Result in Jacobian coordinates
+     * @param m Non-negative scalar of at most scalar_bits() bits
+     * @param P Point to add, may be zero
+     * @param arith Scratch of the calling thread, on the group of this table
+    */
+    void muladd_vartime(mbedtls_ecp_point *R, const mbedtls_mpi *m, const mbedtls_ecp_point *P,
+                        ECP_Arith &arith);
+
+    /**
+     * @return Size of the table in bytes
+    */
+    size_t table_size() const;
+};
+
+
+};  // namespace puf
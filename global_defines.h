@@ -12,12 +12,90 @@
 /* Length of ethernet payload frame */
 #define ETHER_FRAME_LEN             1522
 
+/* Minimum length of an ethernet frame without FCS, shorter frames are padded */
+#define ETHER_MIN_FRAME_LEN         60
+
 /* Elliptic rcCurve */
 #define ELLIPTIC_CURVE              MBEDTLS_ECP_DP_SECP256R1
 
+/* Per-device tables of public keys A kept by an AuthenticationServer: number of
+ * cached devices, window width and maximum length of the challenge d in bits.
+ * A table holds ceil(bits/w) * (2^w - 1) points, i.e. 7.5 KiB for w = 4 and
+ * 32 bits. A cache size of 0 disables the tables. */
+#ifndef KEY_TABLE_CACHE_SIZE
+#ifdef ESP_PLATFORM
+#define KEY_TABLE_CACHE_SIZE        0
+#else
+#define KEY_TABLE_CACHE_SIZE        1024
+#endif
+#endif
+#define KEY_TABLE_WINDOW            4
+#define KEY_TABLE_BITS              32
+
+/* Batch verification of PUF_SYN_ACKs: maximum batch size, smallest batch checked
+ * with the batch equation, latency budget of a queued PUF_SYN_ACK in us and size
+ * of the random coefficients in bits. A batch containing a false equation passes
+ * with probability 2^-BATCH_VERIFY_BITS. The batch equation breaks even with
+ * single checks without key tables at about 96 equations on x86-64; single checks
+ * with a cached key table are cheaper at any batch size. */
+#define BATCH_VERIFY_MAX            256
+#define BATCH_VERIFY_MIN            128
+#define BATCH_VERIFY_LATENCY_US     5000
+#define BATCH_VERIFY_BITS           64
+
+/* Maximum number of data frames per call of the batched Authenticator::validate(),
+ * bounded by the 64 bit result mask */
+#define VALIDATE_BATCH_MAX          64
+
+/* Number of shards of the hash chain table, i.e. the maximum number of threads
+ * validating data frames without sharing memory */
+#define CHAIN_TABLE_SHARDS          16
+
 /* Timeout for network operations in ms */
 #define NETWORK_TIMEOUT_MS          3000
 
+/* Rings of PacketRingNetwork: RX block size and count, size of a frame slot, number
+ * of TX slots and the time in ms after which the kernel hands over a partly filled
+ * RX block */
+#define PACKET_RING_BLOCK_SIZE      (1 << 20)
+#define PACKET_RING_BLOCKS          16
+#define PACKET_RING_FRAME_SIZE      2048
+#define PACKET_RING_TX_FRAMES       2048
+#define PACKET_RING_RETIRE_MS       1
+
+/* Time in ms a MultiQueueAuthenticator worker waits for frames before checking for
+ * stop() and expired sessions */
+#define MULTI_QUEUE_POLL_MS         100
+
+/* Frames queued per direction of a LoopbackNetwork */
+#define LOOPBACK_QUEUE_LEN          1024
+
 /* To be defined during build by cmake */
 #define DEFAULT_RESOURCE    "Supplicant.csv"
-#define DEFAULT_COUNTER     100
\ No newline at end of file
+#define DEFAULT_STORE       "Supplicant.db"
+#define DEFAULT_COUNTER     100
+
+/* Number of slots of a new MappedAuthenticationServer file, a power of two */
+#define STORE_CAPACITY      4096
+
+/* Number of upcoming identities per device indexed by MappedAuthenticationServer,
+ * i.e. how far a supplicant may have hashed its MAC ahead of the server */
+#define CHAIN_LOOKAHEAD     4
+
+/* Minimum number of MACs per thread of advance_macs() and walk_chains() */
+#define MAC_BULK_MIN        4096
+
+/* Write-ahead log of MappedAuthenticationServer: checkpoint interval in ms and size
+ * of the log in bytes that triggers an early checkpoint */
+#define WAL_CHECKPOINT_MS   5000
+#define WAL_CHECKPOINT_BYTES (16 << 20)
+
+/* Maximum number of supplicants an Authenticator tracks at once */
+#define MAX_SESSIONS        65536
+
+/* Time in ms a connected supplicant may send no valid data frame before its session
+ * and flow are removed */
+#define SESSION_IDLE_MS     60000
+
+/* Handshake frames a worker of a HandshakeExecutor may have queued, a power of two */
+#define HANDSHAKE_QUEUE_LEN 1024
@@ -0,0 +1,328 @@
+#include "handshake_executor.h"
+#include "authenticator.h"
+#include "statics.h"
+#include "errors.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+
+
+namespace puf {
+
+
+static uint32_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint32_t>(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+
+HandshakeExecutor::Worker::Worker(size_t queue_len, size_t sessions)
+    : queue(queue_len), sessions(sessions) {
+    stats.handled = 0;
+    stats.stolen = 0;
+}
+
+
+HandshakeExecutor::HandshakeExecutor(Network &net, AuthenticationServer &as, size_t workers)
+    : net(net), as(as), switch_mac(SWITCH_MAC), done(HANDSHAKE_QUEUE_LEN), running(false), dropped_(0),
+      sleeping(0) {
+    if(workers == 0) {
+        workers = std::thread::hardware_concurrency();
+        workers = workers == 0 ? 1 : workers;
+    }
+    for(size_t i=0; i<workers; ++i) {
+        workers_.emplace_back( new Worker(HANDSHAKE_QUEUE_LEN, MAX_SESSIONS / workers + 1) );
+    }
+}
+
+
+HandshakeExecutor::~HandshakeExecutor() {
+    stop();
+}
+
+
+void HandshakeExecutor::start(const MAC &switch_mac) {
+    if( running.exchange(true) ) {
+        return;
+    }
+    this->switch_mac = switch_mac;
+    for(size_t i=0; i<workers_.size(); ++i) {
+        workers_[i]->thread = std::thread(&HandshakeExecutor::run, this, i);
+    }
+}
+
+
+void HandshakeExecutor::stop() {
+    running = false;
+    idle.notify_all();
+    for(auto &w : workers_) {
+        if( w->thread.joinable() ) {
+            w->thread.join();
+        }
+    }
+}
+
+
+size_t HandshakeExecutor::worker_of(const MAC &remote_mac) const {
+    return ((remote_mac.to_u64() * 0x9e3779b97f4a7c15ULL) >> 32) % workers_.size();
+}
+
+
+bool HandshakeExecutor::dispatch(const uint8_t *buf, size_t n) {
+    Task task;
+    MAC src_mac;
+
+    if( n > sizeof(task.buf) || n < sizeof(MAC)*2 ) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    memcpy(task.buf, buf, n);
+    task.len = n;
+    memcpy(src_mac.bytes, buf + sizeof(MAC), sizeof(MAC));
+
+    if( !workers_[worker_of(src_mac)]->queue.push(task) ) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Only a sleeping worker costs a wake-up, which does not block either
+    if( sleeping.load(std::memory_order_acquire) > 0 ) {
+        idle.notify_one();
+    }
+    return true;
+}
+
+
+bool HandshakeExecutor::next(size_t worker, Task &task) {
+    if( workers_[worker]->queue.pop(task) ) {
+        return true;
+    }
+
+    // Steal, starting with the next worker so thieves spread over the victims
+    for(size_t i=1; i<workers_.size(); ++i) {
+        if( workers_[(worker + i) % workers_.size()]->queue.pop(task) ) {
+            workers_[worker]->stats.stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void HandshakeExecutor::run(size_t worker) {
+    Task task;
+    unsigned spins = 0;
+
+    while( running.load(std::memory_order_relaxed) ) {
+        if( next(worker, task) ) {
+            spins = 0;
+            try {
+                switch( deduce_type(task.buf, task.len) ) {
+                    case PUF_CON_E:
+                        on_PUF_CON(task);
+                        break;
+                    case PUF_SYN_ACK_E:
+                        on_PUF_SYN_ACK(task);
+                        break;
+                    default:
+                        break;
+                }
+            } catch(const Exception &e) {
+                puts(e.what());
+            }
+            workers_[worker]->stats.handled.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        if( ++spins < 64 ) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // A wake-up racing with falling asleep is caught by the timeout
+        std::unique_lock<std::mutex> l(idle_lock);
+        sleeping.fetch_add(1, std::memory_order_release);
+        idle.wait_for(l, std::chrono::milliseconds(1));
+        sleeping.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+
+void HandshakeExecutor::finish(const Done &d) {
+    // Only the receiving thread empties the queue, wait for it rather than lose the result
+    while( !done.push(d) ) {
+        std::this_thread::yield();
+    }
+}
+
+
+void HandshakeExecutor::on_PUF_CON(const Task &task) {
+    PUF_CON puf_con;
+    PUF_SYN puf_syn;
+    Done d = {HS_REJECTED_E, {}, {}, {0}, 0};
+    Session s;
+
+    try {
+        puf_con.from_binary( const_cast<uint8_t*>(task.buf), task.len );
+    } catch(const Exception &e) {           // Faulty package or invalid point T
+        puts(e.what());
+        return;
+    }
+    d.remote_mac = puf_con.src_mac;
+
+    // The math runs on a session of its own and on the PUFStatics of this worker
+    s.remote_mac = puf_con.src_mac;
+    if( PUF_CON_phase(s, puf_con, as) != 0 ||
+        PUF_SYN_phase(s, switch_mac, PUFStatics::instance(), puf_syn) != 0 ) {
+        finish(d);
+        return;
+    }
+
+    // The session exists before the PUF_SYN_ACK can arrive
+    Worker &home = *workers_[worker_of(puf_con.src_mac)];
+    {
+        std::lock_guard<std::mutex> guard(home.lock);
+        Session *t = home.sessions.emplace(s, now_ms());
+        if(t == NULL) {
+            puts("Session table is full");
+            finish(d);
+            return;
+        }
+        d.opened_ms = t->opened_ms;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(send_lock);
+        net.send(puf_syn.binary(), puf_syn.header_len());
+    }
+
+    d.type = HS_SYN_SENT_E;
+    finish(d);
+}
+
+
+void HandshakeExecutor::on_PUF_SYN_ACK(const Task &task) {
+    PUF_SYN_ACK puf_syn_ack;
+    Done d = {HS_REJECTED_E, {}, {}, {0}, 0};
+    Session v;
+
+    try {
+        puf_syn_ack.from_binary( const_cast<uint8_t*>(task.buf), task.len );
+    } catch(const Exception &e) {           // Faulty package or invalid point S
+        puts(e.what());
+        return;
+    }
+    d.remote_mac = puf_syn_ack.src_mac;
+
+    // Take what the verification needs and leave the session to others meanwhile
+    Worker &home = *workers_[worker_of(puf_syn_ack.src_mac)];
+    {
+        std::lock_guard<std::mutex> guard(home.lock);
+        Session *s = home.sessions.find(puf_syn_ack.src_mac);
+        if( s == NULL || !s->pending || s->verifying ) {
+            puts("PUF_SYN_ACK without pending handshake");
+            return;
+        }
+        s->verifying = true;
+        v.A = s->A;
+        v.T = s->T;
+        v.d = s->d;
+        v.A_table = s->A_table;
+        d.opened_ms = s->opened_ms;
+    }
+
+    const bool ok = PUF_ACK_phase(v, puf_syn_ack);
+
+    // The handshake is verified, only now may the server move on along the MAC chain
+    if(ok) {
+        as.advance(puf_syn_ack.src_mac);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(home.lock);
+        Session *s = home.sessions.find(puf_syn_ack.src_mac);
+
+        // Session expired or restarted while being verified
+        if( s == NULL || !s->verifying || s->opened_ms != d.opened_ms ) {
+            return;
+        }
+        s->verifying = false;
+        if(!ok) {
+            home.sessions.reject(puf_syn_ack.src_mac);
+        } else {
+            memcpy(d.k, chain_key(*s), sizeof(d.k));
+            d.base_mac = s->base_mac;
+            s->pending = false;
+            s->connected = true;
+            d.type = HS_CONNECTED_E;
+        }
+    }
+    finish(d);
+}
+
+
+size_t HandshakeExecutor::poll(ChainTable &chains, std::vector<HandshakeEvent> &events) {
+    Done d;
+    size_t n = 0;
+
+    while( done.pop(d) ) {
+        HandshakeEvent ev = {static_cast<handshake_event_e>(d.type), d.remote_mac};
+
+        // Data frames are validated against the chain table only
+        if( d.type == HS_CONNECTED_E && chains.insert(d.remote_mac, d.k, &d.base_mac, now_ms()) == NULL ) {
+            puts("Chain table is full");
+            Worker &home = *workers_[worker_of(d.remote_mac)];
+            std::lock_guard<std::mutex> guard(home.lock);
+            Session *s = home.sessions.find(d.remote_mac);
+            if( s != NULL && s->opened_ms == d.opened_ms ) {
+                home.sessions.erase(d.remote_mac);
+            }
+            ev.type = HS_REJECTED_E;
+        }
+        events.push_back(ev);
+        n++;
+    }
+    return n;
+}
+
+
+size_t HandshakeExecutor::expire(ChainTable &chains) {
+    const uint32_t now = now_ms();
+    size_t n = 0;
+    for(auto &w : workers_) {
+        std::lock_guard<std::mutex> guard(w->lock);
+        n += w->sessions.expire(now, NETWORK_TIMEOUT_MS, &chains);
+    }
+    return n;
+}
+
+
+bool HandshakeExecutor::connected(const MAC &remote_mac) {
+    Worker &home = *workers_[worker_of(remote_mac)];
+    std::lock_guard<std::mutex> guard(home.lock);
+    Session *s = home.sessions.find(remote_mac);
+    return s != NULL && s->connected;
+}
+
+
+size_t HandshakeExecutor::workers() const {
+    return workers_.size();
+}
+
+
+const HandshakeExecutor::WorkerStats& HandshakeExecutor::stats(size_t worker) const {
+    return workers_[worker]->stats;
+}
+
+
+uint64_t HandshakeExecutor::dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+
+};  // namespace puf
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "chain_table.h"
+#include "mpmc_queue.h"
+#include "platform.h"
+#include "session.h"
+
+namespace puf {
+
+
+struct HandshakeEvent;
+
+
+/**
+ * Pool of threads doing the work of handshakes, i.e. the query, the two scalar
+ * multiplications of PUF_SYN and the verification of PUF_SYN_ACK, for a receiving
+ * thread that only classifies frames, see Authenticator::offload().
+ *
+ * dispatch() puts a handshake frame into the lock-free queue of the home worker of
+ * its sender and never blocks; a full queue drops the frame. Each worker keeps the
+ * sessions of the supplicants at home with it, so all frames of a handshake
+ * normally run on one core. An idle worker steals frames from the queues of the
+ * others, taking the lock of the owner's sessions for the short moments it touches
+ * them; the math runs outside of any lock. Workers send PUF_SYNs themselves, one
+ * at a time, and hand finished handshakes back through another lock-free queue.
+ * poll(), again on the receiving thread, opens their flows in the ChainTable, so
+ * only that thread changes the table.
+*/
+class HandshakeExecutor {
+public:
+    /**
+     * Counters of a worker
+    */
+    typedef struct alignas(64) WorkerStats {
+        std::atomic<uint64_t> handled;      // Frames handled
+        std::atomic<uint64_t> stolen;       // Frames taken from the queues of other workers
+    } WorkerStats;
+
+private:
+    typedef struct Task {
+        uint8_t buf[128];
+        uint16_t len;
+    } Task;
+
+    typedef struct Done {
+        uint8_t type;                       // handshake_event_e
+        MAC remote_mac;
+        MAC base_mac;                       // HS_CONNECTED_E only
+        uint8_t k[4];                       // 4 bytes of the shared secret, HS_CONNECTED_E only
+        uint32_t opened_ms;
+    } Done;
+
+    typedef struct Worker {
+        MPMCQueue<Task> queue;
+        std::mutex lock;                    // Guards sessions
+        SessionTable sessions;
+        std::thread thread;
+        WorkerStats stats;
+
+        Worker(size_t queue_len, size_t sessions);
+    } Worker;
+
+    Network &net;
+    AuthenticationServer &as;
+    MAC switch_mac;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    MPMCQueue<Done> done;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> dropped_;
+
+    std::mutex send_lock;
+    std::mutex idle_lock;
+    std::condition_variable idle;
+    std::atomic<unsigned> sleeping;
+
+    HandshakeExecutor(const HandshakeExecutor&) = delete;
+    HandshakeExecutor& operator=(const HandshakeExecutor&) = delete;
+
+    void run(size_t worker);
+    bool next(size_t worker, Task &task);
+    void finish(const Done &d);
+    void on_PUF_CON(const Task &task);
+    void on_PUF_SYN_ACK(const Task &task);
+
+public:
+    /**
+     * @param net Network the PUF_SYNs are sent on, shared with the receiving thread
+     * @param as The server, must be thread-safe, see AuthenticationServer
+     * @param workers Number of worker threads, 0 for one per core
+    */
+    HandshakeExecutor(Network &net, AuthenticationServer &as, size_t workers = 0);
+    ~HandshakeExecutor();
+
+    /**
+     * Starts the workers
+     * @param switch_mac Source MAC of the PUF_SYNs
+    */
+    void start(const MAC &switch_mac);
+    void stop();
+
+    /**
+     * Hands a PUF_CON or PUF_SYN_ACK to the home worker of its sender
+     * @param buf The frame, copied
+     * @param n Length of the frame
+     * @return False if the frame was dropped because the queue is full or too long
+    */
+    bool dispatch(const uint8_t *buf, size_t n);
+
+    /**
+     * Collects finished handshakes and opens the flows of the connected ones, replacing
+     * the flow of an earlier handshake under the same MAC.
+     * Must be called by the thread that owns the flows of chains.
+     * @param chains The table the flows are opened in
+     * @param events Receives a HS_SYN_SENT_E, HS_CONNECTED_E or HS_REJECTED_E per handshake step
+     * @return Number of appended events
+    */
+    size_t poll(ChainTable &chains, std::vector<HandshakeEvent> &events);
+
+    /**
+     * Removes sessions whose handshake has not completed within NETWORK_TIMEOUT_MS,
+     * and connected sessions together with their flows once these have been idle for
+     * SESSION_IDLE_MS or have ended, see SessionTable::expire().
+     * Must be called by the thread that owns the flows of chains.
+     * @param chains The table the flows were opened in by poll()
+     * @return Number of removed sessions
+    */
+    size_t expire(ChainTable &chains);
+
+    bool connected(const MAC &remote_mac);
+
+    size_t workers() const;
+
+    /**
+     * @return The home worker of a supplicant
+    */
+    size_t worker_of(const MAC &remote_mac) const;
+
+    const WorkerStats& stats(size_t worker) const;
+
+    /**
+     * @return Frames dropped by dispatch()
+    */
+    uint64_t dropped() const;
+};
+
+
+};  // namespace puf
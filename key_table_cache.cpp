@@ -0,0 +1,102 @@
+#include "key_table_cache.h"
+#include "statics.h"
+
+
+namespace puf {
+
+
+KeyTableCache::KeyTableCache(size_t capacity, unsigned window_bits, size_t scalar_bits) :
+    capacity_(capacity),
+    window(window_bits),
+    scalar_bits(scalar_bits),
+    hits_(0),
+    misses_(0),
+    evictions_(0)
+{
+    index.reserve(capacity);
+}
+
+
+std::shared_ptr<FixedBase> KeyTableCache::get(const MAC& base_mac, const ECP_Point& A) {
+    const uint64_t key = base_mac.to_u64();
+
+    if( capacity_ == 0 || window == 0 ) {
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = index.find(key);
+    if( it != index.end() ) {
+        if( it->second->table->is_base(A) ) {
+            ++hits_;
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->table;
+        }
+
+        // Supplicant registered a new A
+        lru.erase(it->second);
+        index.erase(it);
+    }
+
+    ++misses_;
+    if( lru.size() >= capacity_ ) {
+        index.erase(lru.back().key);
+        lru.pop_back();
+        ++evictions_;
+    }
+
+    std::shared_ptr<FixedBase> table = std::make_shared<FixedBase>(
+        PUFStatics::curve(), window, &A, scalar_bits);
+    lru.push_front( {key, table} );
+    index[key] = lru.begin();
+    return table;
+}
+
+
+void KeyTableCache::erase(const MAC& base_mac) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = index.find( base_mac.to_u64() );
+    if( it != index.end() ) {
+        lru.erase(it->second);
+        index.erase(it);
+    }
+}
+
+
+void KeyTableCache::clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    lru.clear();
+    index.clear();
+}
+
+
+size_t KeyTableCache::size() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return lru.size();
+}
+
+
+size_t KeyTableCache::capacity() const {
+    return capacity_;
+}
+
+
+size_t KeyTableCache::hits() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return hits_;
+}
+
+
+size_t KeyTableCache::misses() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return misses_;
+}
+
+
+size_t KeyTableCache::evictions() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return evictions_;
+}
+
+
+};  // namespace puf
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "packets.h"
+#include "math.h"
+#include "fixed_base.h"
+
+namespace puf {
+
+
+/**
+ * Size-bounded LRU cache of precomputed tables of the public keys A of supplicants,
+ * keyed by their base MAC. An AuthenticationServer may keep one next to its entries
+ * so that repeated verifications of a device skip the table setup. Tables are shared
+ * with the sessions using them and stay valid after eviction. The cache is
+ * thread-safe, and a table may be used by several threads at once, see FixedBase.
+*/
+class KeyTableCache {
+private:
+    typedef struct Entry {
+        uint64_t key;
+        std::shared_ptr<FixedBase> table;
+    } Entry;
+
+    std::list<Entry> lru;               // Most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    size_t capacity_;
+    unsigned window;
+    size_t scalar_bits;
+    size_t hits_;
+    size_t misses_;
+    size_t evictions_;
+    mutable std::mutex lock;
+
+public:
+    /**
+     * @param capacity Maximum number of tables, 0 disables the cache. Defaults to KEY_TABLE_CACHE_SIZE
+     * @param window_bits Window width of the tables. Defaults to KEY_TABLE_WINDOW
+     * @param scalar_bits Maximum length of the challenges d. Defaults to KEY_TABLE_BITS
+    */
+    KeyTableCache(size_t capacity = KEY_TABLE_CACHE_SIZE, unsigned window_bits = KEY_TABLE_WINDOW,
+                  size_t scalar_bits = KEY_TABLE_BITS);
+    KeyTableCache(const KeyTableCache&) = delete;
+    KeyTableCache& operator=(const KeyTableCache&) = delete;
+
+    /**
+     * Looks up the table of a supplicant and creates it on a miss, evicting the least
+     * recently used table if the cache is full. A cached table of a different A is
+     * replaced. The table itself is built on its first use.
+     * @param base_mac The base MAC of the supplicant
+     * @param A Public key A of the supplicant
+     * @return The table or NULL if the cache is disabled
+    */
+    std::shared_ptr<FixedBase> get(const MAC& base_mac, const ECP_Point& A);
+
+    /**
+     * Drops the table of a supplicant, e.g. after it registered a new A
+     * @param base_mac The base MAC of the supplicant
+    */
+    void erase(const MAC& base_mac);
+
+    void clear();
+
+    size_t size() const;
+    size_t capacity() const;
+    size_t hits() const;
+    size_t misses() const;
+    size_t evictions() const;
+};
+
+
+};  // namespace puf
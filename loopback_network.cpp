@@ -0,0 +1,121 @@
+#include "loopback_network.h"
+
+#include <chrono>
+
+
+namespace puf {
+
+
+LoopbackNetwork::Queue::Queue()
+    : slots(LOOPBACK_QUEUE_LEN * ETHER_FRAME_LEN), lens(LOOPBACK_QUEUE_LEN), head(0), count(0), dropped(0) { }
+
+
+LoopbackNetwork::LoopbackNetwork(int timeout_ms) : rx(new Queue()), timeout_ms(timeout_ms) { }
+
+
+void LoopbackNetwork::connect(LoopbackNetwork &a, LoopbackNetwork &b) {
+    a.tx = b.rx;
+    b.tx = a.rx;
+}
+
+
+void LoopbackNetwork::init() {
+    if( !tx ) {
+        throw NetworkException("Loopback: Not connected");
+    }
+}
+
+
+bool LoopbackNetwork::push(Queue &q, const uint8_t *header, size_t header_len, const uint8_t *data, size_t data_len) {
+    if( q.count == LOOPBACK_QUEUE_LEN ) {
+        q.dropped++;
+        return false;
+    }
+    const size_t i = (q.head + q.count) % LOOPBACK_QUEUE_LEN;
+    uint8_t *slot = &q.slots[i * ETHER_FRAME_LEN];
+    memcpy(slot, header, header_len);
+    if(data_len > 0) {
+        memcpy(slot + header_len, data, data_len);
+    }
+    q.lens[i] = header_len + data_len;
+    q.count++;
+    return true;
+}
+
+
+void LoopbackNetwork::send(uint8_t *buf, size_t bufSize) {
+    send_gather(buf, bufSize, NULL, 0);
+}
+
+
+void LoopbackNetwork::send_gather(const uint8_t *header, size_t header_len, const uint8_t *data, size_t data_len) {
+    if( header_len + data_len > ETHER_FRAME_LEN ) {
+        throw NetworkException("Frame too large");
+    }
+    init();
+    {
+        std::lock_guard<std::mutex> lock(tx->lock);
+        push(*tx, header, header_len, data, data_len);
+    }
+    tx->ready.notify_one();
+}
+
+
+size_t LoopbackNetwork::send_batch(const Frame *frames, size_t n) {
+    init();
+    for(size_t i=0; i<n; ++i) {
+        if( frames[i].len > ETHER_FRAME_LEN ) {
+            throw NetworkException("Frame too large");
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(tx->lock);
+        for(size_t i=0; i<n; ++i) {
+            push(*tx, frames[i].buf, frames[i].len, NULL, 0);
+        }
+    }
+    tx->ready.notify_one();
+    return n;
+}
+
+
+int LoopbackNetwork::receive(uint8_t *buf, size_t bufSize) {
+    Frame f = {buf, 0, bufSize};
+    if( receive_batch(&f, 1) == 0 ) {
+        return -1;
+    }
+    return static_cast<int>(f.len);
+}
+
+
+size_t LoopbackNetwork::receive_batch(Frame *frames, size_t n) {
+    std::unique_lock<std::mutex> lock(rx->lock);
+    if( n == 0 || !rx->ready.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]{ return rx->count > 0; }) ) {
+        return 0;
+    }
+
+    size_t m = 0;
+    for(; m<n && rx->count>0; ++m) {
+        const size_t len = rx->lens[rx->head];
+        frames[m].len = len < frames[m].size ? len : frames[m].size;
+        memcpy(frames[m].buf, &rx->slots[rx->head * ETHER_FRAME_LEN], frames[m].len);
+        rx->head = (rx->head + 1) % LOOPBACK_QUEUE_LEN;
+        rx->count--;
+    }
+    return m;
+}
+
+
+size_t LoopbackNetwork::pending() const {
+    std::lock_guard<std::mutex> lock(rx->lock);
+    return rx->count;
+}
+
+
+size_t LoopbackNetwork::dropped() const {
+    std::lock_guard<std::mutex> lock(rx->lock);
+    return rx->dropped;
+}
+
+
+};  // namespace puf
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "platform.h"
+
+namespace puf {
+
+
+/**
+ * In-process Network, e.g. to run a Supplicant against an Authenticator without
+ * hardware. Two instances are linked with connect(), frames sent by one are
+ * received by the other in order. Every direction queues up to LOOPBACK_QUEUE_LEN
+ * frames, further frames are dropped like on a congested link.
+*/
+class LoopbackNetwork : public Network {
+private:
+    typedef struct Queue {
+        std::mutex lock;
+        std::condition_variable ready;
+        std::vector<uint8_t> slots;     // LOOPBACK_QUEUE_LEN frames of ETHER_FRAME_LEN bytes
+        std::vector<size_t> lens;
+        size_t head;                    // Oldest frame
+        size_t count;
+        size_t dropped;
+
+        Queue();
+    } Queue;
+
+    std::shared_ptr<Queue> rx;          // Own queue
+    std::shared_ptr<Queue> tx;          // Queue of the peer
+    int timeout_ms;
+
+    static bool push(Queue &q, const uint8_t *header, size_t header_len, const uint8_t *data, size_t data_len);
+
+public:
+    /**
+     * @param timeout_ms Time receive() waits for a frame. Defaults to NETWORK_TIMEOUT_MS
+    */
+    LoopbackNetwork(int timeout_ms = NETWORK_TIMEOUT_MS);
+
+    /**
+     * Links two networks in both directions
+    */
+    static void connect(LoopbackNetwork &a, LoopbackNetwork &b);
+
+    void init() override;
+    void send(uint8_t *buf, size_t bufSize) override;
+    void send_gather(const uint8_t *header, size_t header_len, const uint8_t *data, size_t data_len) override;
+    size_t send_batch(const Frame *frames, size_t n) override;
+
+    /**
+     * @return The length of the frame, -1 on timeout
+    */
+    int receive(uint8_t *buf, size_t bufSize) override;
+    size_t receive_batch(Frame *frames, size_t n) override;
+
+    /**
+     * @return Number of frames waiting to be received
+    */
+    size_t pending() const;
+
+    /**
+     * @return Number of frames dropped because this network's queue was full
+    */
+    size_t dropped() const;
+};
+
+
+};  // namespace puf
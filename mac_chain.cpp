@@ -0,0 +1,70 @@
+#include "mac_chain.h"
+#include "sha256_fixed.h"
+
+#include <algorithm>
+#include <thread>
+
+
+namespace puf {
+
+
+static_assert(sizeof(MAC) == 6, "MACs must be packed for sha256_mac_iterate()");
+
+
+/* Runs fn(begin, end) on parts of [0, n) in parallel, at least MAC_BULK_MIN items each */
+template<typename F>
+static void parallel(size_t n, unsigned threads, F fn) {
+    if(threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if( threads > n / MAC_BULK_MIN ) {
+        threads = n / MAC_BULK_MIN;
+    }
+    if(threads <= 1) {
+        fn(0, n);
+        return;
+    }
+
+    // Parts of whole vectors, so that only the last one has a partial vector
+    const size_t lanes = sha256_lanes();
+    const size_t part = (n / threads + lanes - 1) / lanes * lanes;
+    std::vector<std::thread> workers;
+    for(size_t begin = part; begin < n; begin += part) {
+        workers.emplace_back(fn, begin, std::min(begin + part, n));
+    }
+    fn(0, std::min(part, n));
+    for(std::thread &t : workers) {
+        t.join();
+    }
+}
+
+
+void advance_macs(MAC *macs, size_t n, uint32_t steps, unsigned threads) {
+    parallel(n, threads, [macs, steps](size_t begin, size_t end) {
+        sha256_mac_iterate(macs[begin].bytes, end - begin, steps);
+    });
+}
+
+
+void walk_chains(MAC *chains, size_t n, unsigned length, unsigned threads) {
+    parallel(n, threads, [chains, length](size_t begin, size_t end) {
+        MAC column[16];
+
+        // One value of 16 chains per call, transposed through a small buffer
+        for(size_t i = begin; i < end; i += 16) {
+            const size_t m = std::min<size_t>(16, end - i);
+            for(unsigned j=1; j<length; ++j) {
+                for(size_t c=0; c<m; ++c) {
+                    column[c] = chains[(i + c) * length + j - 1];
+                }
+                sha256_mac_iterate(column[0].bytes, m, 1);
+                for(size_t c=0; c<m; ++c) {
+                    chains[(i + c) * length + j] = column[c];
+                }
+            }
+        }
+    });
+}
+
+
+};  // namespace puf
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include "packets.h"
+
+namespace puf {
+
+
+/**
+ * Hashes many MACs at once, each as MAC::hash(steps) does. The MACs are split
+ * between threads and each thread hashes sha256_lanes() MACs per instruction.
+ * @param macs The MACs, replaced by the results
+ * @param n Number of MACs
+ * @param steps Number of hashes per MAC
+ * @param threads Number of threads, 0 for one per core
+*/
+void advance_macs(MAC *macs, size_t n, uint32_t steps, unsigned threads = 0);
+
+/**
+ * Walks many chains at once, as advance_macs() does. Row i of chains holds length
+ * consecutive values of chain i, the first one given: chains[i*length + j] becomes
+ * H^j(chains[i*length]).
+ * @param chains n rows of length MACs
+ * @param n Number of chains
+ * @param length Number of values per chain, at least 1
+ * @param threads Number of threads, 0 for one per core
+*/
+void walk_chains(MAC *chains, size_t n, unsigned length, unsigned threads = 0);
+
+
+};  // namespace puf
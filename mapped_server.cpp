@@ -0,0 +1,479 @@
+#include "mapped_server.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+namespace puf {
+
+
+static const char STORE_MAGIC[8] = {'P', 'U', 'F', 'S', 'T', 'O', 'R', 'E'};
+static const uint32_t STORE_VERSION = 2;
+
+/* MACs take 48 bits, so this key never belongs to a supplicant */
+static const uint64_t STORE_EMPTY = ~static_cast<uint64_t>(0);
+
+
+static uint64_t mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+
+/**
+ * Makes a rename within the directory of file durable
+ * @return False on failure
+*/
+static bool sync_dir(const std::string &file) {
+    const size_t slash = file.find_last_of('/');
+    const std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : file.substr(0, slash);
+
+    const int d = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if(d < 0) {
+        return false;
+    }
+    const bool ok = fsync(d) == 0 || errno == EINVAL;      // Some file systems do not sync directories
+    close(d);
+    return ok;
+}
+
+
+MappedAuthenticationServer::MappedAuthenticationServer(const char *path, size_t capacity, size_t table_cache_size,
+                                                       bool logged)
+    : path(path), initial_capacity(16), fd(-1), base(NULL), len(0), header(NULL), records(NULL),
+      tables(table_cache_size) {
+    while( initial_capacity < capacity ) {
+        initial_capacity <<= 1;
+    }
+    if(logged) {
+        wal.reset( new WriteAheadLog(this->path + ".wal") );
+    }
+}
+
+
+MappedAuthenticationServer::~MappedAuthenticationServer() {
+    wal.reset();
+    unmap();
+}
+
+
+void MappedAuthenticationServer::map(const std::string &file, size_t capacity) {
+    static const StoreHeader blank = {};
+    StoreHeader h;
+    struct stat st;
+
+    fd = open(file.c_str(), O_RDWR | O_CREAT, 0644);
+    if( fd < 0 || fstat(fd, &st) != 0 ) {
+        unmap();
+        throw Exception("Store: Could not open file");
+    }
+
+    // The header is written last, a file without one was never completely created
+    bool created = st.st_size == 0;
+    if( !created && st.st_size >= static_cast<off_t>(sizeof(h)) &&
+        pread(fd, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h)) && memcmp(&h, &blank, sizeof(h)) == 0 ) {
+        created = true;
+    }
+
+    if(created) {
+        len = sizeof(StoreHeader) + capacity * sizeof(StoreRecord);
+        if( ftruncate(fd, 0) != 0 || ftruncate(fd, len) != 0 ) {
+            unmap();
+            throw Exception("Store: Could not size file");
+        }
+    } else {
+        len = st.st_size;
+    }
+
+    void *m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(m == MAP_FAILED) {
+        len = 0;
+        unmap();
+        throw Exception("Store: Could not map file");
+    }
+    base = static_cast<uint8_t*>(m);
+    header = reinterpret_cast<StoreHeader*>(base);
+    records = reinterpret_cast<StoreRecord*>(base + sizeof(StoreHeader));
+
+    if(created) {
+        for(size_t i=0; i<capacity; ++i) {
+            records[i].key = STORE_EMPTY;
+        }
+        if( msync(base, len, MS_SYNC) != 0 ) {
+            unmap();
+            throw Exception("Store: Could not write file");
+        }
+        header->version = STORE_VERSION;
+        header->record_size = sizeof(StoreRecord);
+        header->capacity = capacity;
+        header->used = 0;
+        memcpy(header->magic, STORE_MAGIC, sizeof(STORE_MAGIC));
+        return;
+    }
+
+    // Every probe sequence must end in a free slot
+    if( len < sizeof(StoreHeader) || memcmp(header->magic, STORE_MAGIC, sizeof(STORE_MAGIC)) != 0 ||
+        header->version != STORE_VERSION || header->record_size != sizeof(StoreRecord) ||
+        header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0 ||
+        (len - sizeof(StoreHeader)) % sizeof(StoreRecord) != 0 ||
+        (len - sizeof(StoreHeader)) / sizeof(StoreRecord) != header->capacity ||
+        header->used >= header->capacity ) {
+        unmap();
+        throw Exception("Store: Faulty file");
+    }
+}
+
+
+void MappedAuthenticationServer::unmap() {
+    if(base != NULL) {
+        munmap(base, len);
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+    fd = -1;
+    base = NULL;
+    len = 0;
+    header = NULL;
+    records = NULL;
+}
+
+
+void MappedAuthenticationServer::grow() {
+    const int old_fd = fd;
+    uint8_t *old_base = base;
+    const size_t old_len = len;
+    const StoreRecord *old = records;
+    const size_t old_capacity = header->capacity;
+    const std::string tmp = path + ".tmp";
+
+    auto restore = [&]() {
+        fd = old_fd;
+        base = old_base;
+        len = old_len;
+        header = reinterpret_cast<StoreHeader*>(base);
+        records = reinterpret_cast<StoreRecord*>(base + sizeof(StoreHeader));
+    };
+
+    // A checkpoint writing the file back holds on to the old mapping until it is done
+    std::lock_guard<std::mutex> pin(mapping);
+
+    // Build the doubled table next to the file and replace the file once complete
+    unlink(tmp.c_str());
+    fd = -1;
+    base = NULL;
+    try {
+        map(tmp, old_capacity * 2);
+    } catch(const Exception &e) {
+        restore();
+        throw;
+    }
+
+    for(size_t i=0; i<old_capacity; ++i) {
+        if(old[i].key != STORE_EMPTY) {
+            *probe(old[i].key) = old[i];
+            header->used++;
+        }
+    }
+
+    // The new file is on disk before it replaces the old one
+    if( msync(base, len, MS_SYNC) != 0 || fsync(fd) != 0 || rename(tmp.c_str(), path.c_str()) != 0 ) {
+        unmap();
+        unlink(tmp.c_str());
+        restore();
+        throw Exception("Store: Could not replace file");
+    }
+    munmap(old_base, old_len);
+    close(old_fd);
+
+    // And the replacement is, before a checkpoint drops the log holding the changes
+    if( !sync_dir(path) ) {
+        throw Exception("Store: Could not sync directory");
+    }
+}
+
+
+StoreRecord* MappedAuthenticationServer::probe(uint64_t key) const {
+    const size_t mask = header->capacity - 1;
+    size_t i = mix(key) & mask;
+
+    // Never full, so every probe sequence ends in the record or a free slot
+    while( records[i].key != key && records[i].key != STORE_EMPTY ) {
+        i = (i + 1) & mask;
+    }
+    return &records[i];
+}
+
+
+StoreRecord* MappedAuthenticationServer::upsert(uint64_t key) {
+    StoreRecord *r = probe(key);
+    if( r->key == STORE_EMPTY ) {
+        if( (header->used + 1) * 4 > header->capacity * 3 ) {
+            grow();
+            r = probe(key);
+        }
+        r->key = key;
+        header->used++;
+    }
+    return r;
+}
+
+
+void MappedAuthenticationServer::apply(const WalRecord &rec) {
+    MAC hashed_mac;
+    memcpy(hashed_mac.bytes, rec.hashed_mac, sizeof(hashed_mac.bytes));
+    const uint64_t key = hashed_mac.to_u64();
+
+    if(rec.type == WAL_STORE_E && rec.A_len <= sizeof(StoreRecord::A)) {
+        StoreRecord *r = upsert(key);
+        memcpy(r->base_mac, rec.base_mac, sizeof(r->base_mac));
+        memcpy(r->A, rec.A, rec.A_len);
+        r->A_len = rec.A_len;
+        r->ctr = rec.ctr;
+        memcpy(r->mac, rec.hashed_mac, sizeof(r->mac));
+        r->step = 0;
+    } else if(rec.type == WAL_COUNTER_E) {
+        StoreRecord *r = probe(key);
+        if(r->key == key) {
+            r->ctr = rec.ctr;
+            memcpy(r->mac, rec.mac, sizeof(r->mac));
+            r->step = rec.step;
+        }
+    }
+}
+
+
+WalRecord MappedAuthenticationServer::counter_record(const StoreRecord &r) {
+    WalRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.type = WAL_COUNTER_E;
+    memcpy(rec.hashed_mac, &r.key, sizeof(rec.hashed_mac));    // Inverse of MAC::to_u64()
+    memcpy(rec.mac, r.mac, sizeof(rec.mac));
+    rec.step = r.step;
+    rec.ctr = r.ctr;
+    return rec;
+}
+
+
+void MappedAuthenticationServer::sync_data() {
+    // Not under lock, store() and query() go on while the pages are written back
+    std::lock_guard<std::mutex> pin(mapping);
+
+    // A checkpoint keeps the log unless the file is on disk
+    if( base != NULL && msync(base, len, MS_SYNC) != 0 ) {
+        throw Exception("Store: Could not write file back");
+    }
+}
+
+
+void MappedAuthenticationServer::fetch() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(base != NULL) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> pin(mapping);
+            map(path, initial_capacity);
+        }
+        if(wal) {
+            wal->open([this](const WalRecord &rec) { apply(rec); });
+        }
+
+        // The lookahead identities of all devices are hashed in parallel
+        std::vector<uint64_t> keys;
+        std::vector<MAC> macs;
+        std::vector<uint32_t> steps;
+        keys.reserve(header->used);
+        macs.reserve(header->used);
+        steps.reserve(header->used);
+        for(size_t i=0; i<header->capacity; ++i) {
+            if(records[i].key != STORE_EMPTY) {
+                MAC mac;
+                memcpy(mac.bytes, records[i].mac, sizeof(mac.bytes));
+                keys.push_back(records[i].key);
+                macs.push_back(mac);
+                steps.push_back(records[i].step);
+            }
+        }
+        index.clear();
+        index.add_many(keys.data(), macs.data(), steps.data(), keys.size());
+    }
+
+    // Replayed changes are written back before the log is dropped
+    if(wal) {
+        wal->checkpoint([this]() { sync_data(); });
+        wal->start([this]() { sync_data(); });
+    }
+}
+
+
+void MappedAuthenticationServer::sync() {
+    if(wal) {
+        wal->checkpoint([this]() { sync_data(); });
+    } else {
+        sync_data();
+    }
+}
+
+
+void MappedAuthenticationServer::store(const MAC& base_mac, const ECP_Point& A, MAC& hashed_mac, int ctr) {
+    WalRecord rec;
+    uint64_t lsn = 0;
+
+    if( A.len() > sizeof(StoreRecord::A) ) {
+        throw Exception("Store: Key too large");
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.type = WAL_STORE_E;
+    memcpy(rec.hashed_mac, hashed_mac.bytes, sizeof(rec.hashed_mac));
+    memcpy(rec.base_mac, base_mac.bytes, sizeof(rec.base_mac));
+    memcpy(rec.A, A.binary(), A.len());
+    rec.A_len = A.len();
+    rec.ctr = ctr;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(base == NULL) {
+            throw Exception("Store: Not fetched");
+        }
+        // Registering again restarts the chain
+        const uint64_t key = hashed_mac.to_u64();
+        const StoreRecord *old = probe(key);
+        if(old->key == key) {
+            MAC mac;
+            memcpy(mac.bytes, old->mac, sizeof(mac.bytes));
+            index.remove(key, mac);
+        }
+        apply(rec);
+        index.add(key, hashed_mac, 0);
+        if(wal) {
+            lsn = wal->append(rec);
+        }
+        tables.erase(base_mac);
+    }
+
+    // Outside the lock, so that concurrent changes share the commit
+    if(wal) {
+        wal->commit(lsn);
+    }
+}
+
+
+QueryResult MappedAuthenticationServer::query(const MAC& hashed_mac, bool decrease_counter) {
+    QueryResult q;
+    uint64_t lsn = 0;
+    q.step = 0;
+    q.valid = false;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(base == NULL) {
+            return q;
+        }
+        uint64_t key;
+        uint16_t step;
+        if( !index.find(hashed_mac, key, step) ) {
+            return q;
+        }
+        StoreRecord *r = probe(key);
+        if( r->key == STORE_EMPTY || r->ctr <= 0 || q.ecp.from_binary(r->A, r->A_len) != 0 ) {
+            return q;
+        }
+        // The window stays where it is until the handshake under h_j is verified
+        q.step = ChainIndex::step_of(step, r->step);
+        if(decrease_counter) {
+            r->ctr--;
+            if(wal) {
+                WalRecord rec = counter_record(*r);
+                lsn = wal->append(rec);
+            }
+        }
+        memcpy(q.mac.bytes, r->base_mac, sizeof(q.mac.bytes));
+        q.valid = true;
+    }
+
+    // Access is granted only once the decrement is durable
+    if(lsn != 0) {
+        wal->commit(lsn);
+    }
+    return q;
+}
+
+
+void MappedAuthenticationServer::advance(const MAC& hashed_mac) {
+    std::lock_guard<std::mutex> guard(lock);
+    if(base == NULL) {
+        return;
+    }
+    uint64_t key;
+    uint16_t step;
+    if( !index.find(hashed_mac, key, step) ) {
+        return;
+    }
+    StoreRecord *r = probe(key);
+    if( r->key == STORE_EMPTY ) {
+        return;
+    }
+
+    // The supplicant used h_j, so the window starts there from now on
+    const uint32_t j = ChainIndex::step_of(step, r->step);
+    if(j == r->step) {
+        return;
+    }
+    MAC mac;
+    memcpy(mac.bytes, r->mac, sizeof(mac.bytes));
+    mac = index.roll(key, mac, r->step, j);
+    memcpy(r->mac, mac.bytes, sizeof(r->mac));
+    r->step = j;
+    if(wal) {
+        // Not committed, the next group commit or checkpoint takes it along. A lost
+        // advance on a crash only leaves the window behind.
+        WalRecord rec = counter_record(*r);
+        wal->append(rec);
+    }
+}
+
+
+KeyTableCache* MappedAuthenticationServer::key_tables() {
+    return &tables;
+}
+
+
+size_t MappedAuthenticationServer::size() {
+    std::lock_guard<std::mutex> guard(lock);
+    return header == NULL ? 0 : header->used;
+}
+
+
+size_t MappedAuthenticationServer::capacity() {
+    std::lock_guard<std::mutex> guard(lock);
+    return header == NULL ? 0 : header->capacity;
+}
+
+
+int MappedAuthenticationServer::counter(const MAC& hashed_mac) {
+    std::lock_guard<std::mutex> guard(lock);
+    if(base == NULL) {
+        return -1;
+    }
+    const StoreRecord *r = probe( hashed_mac.to_u64() );
+    return r->key == STORE_EMPTY ? -1 : r->ctr;
+}
+
+
+};  // namespace puf
+
+#endif  // __linux__
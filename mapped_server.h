@@ -0,0 +1,137 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "chain_index.h"
+#include "platform.h"
+#include "wal.h"
+
+namespace puf {
+
+
+/**
+ * Record of a supplicant in the file of a MappedAuthenticationServer
+*/
+typedef struct alignas(128) StoreRecord {
+    uint64_t key;               // Hashed MAC as MAC::to_u64(), STORE_EMPTY if the slot is free
+    int32_t ctr;                // Counter
+    uint8_t base_mac[6];
+    uint8_t A_len;              // Length of A
+    uint8_t reserved;
+    uint8_t A[65];              // Public key A, binary
+    uint8_t mac[6];             // Current identity h_step, the key at step 0
+    uint32_t step;              // Position in the MAC chain
+} StoreRecord;
+
+
+/**
+ * Header at the start of the file, padded to the size of a record
+*/
+typedef struct alignas(128) StoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;          // Number of slots, a power of two
+    uint64_t used;              // Number of records
+} StoreHeader;
+
+
+/**
+ * AuthenticationServer on a memory mapped file holding an open addressing hash table
+ * of fixed size records keyed by hashed MAC, probed linearly. fetch() only maps the
+ * file, query() follows a single probe sequence and store() and the counter
+ * decrements of query() update the records in place, so nothing is parsed or
+ * rewritten. The table doubles once it is 3/4 full.
+ *
+ * The file is in host byte order. Changes reach the file when the kernel writes the
+ * pages back, i.e. survive a crash of the process. Unless disabled, every change is
+ * also appended to a WriteAheadLog next to the file and committed before store() or
+ * query() return, so changes survive a crash of the machine, at the cost of one
+ * fdatasync() per group of concurrent changes. A background thread checkpoints the
+ * log, fetch() replays it. Without the log, sync() writes the changes to disk.
+ * store() and query() are thread-safe and only wait for a checkpoint writing the
+ * file back while the table doubles.
+ *
+ * Records are keyed by the hashed MAC a supplicant registered with. query() looks
+ * identities up in a ChainIndex built by fetch(), so a supplicant that hashed its MAC
+ * up to CHAIN_LOOKAHEAD-1 steps further is found without re-hashing. query() leaves
+ * the window alone, the record is rolled forward to the step a supplicant used by
+ * advance() once its handshake is verified.
+*/
+class MappedAuthenticationServer : public AuthenticationServer {
+private:
+    std::string path;
+    size_t initial_capacity;
+    int fd;
+    uint8_t *base;
+    size_t len;
+    StoreHeader *header;
+    StoreRecord *records;
+    std::mutex lock;
+    std::mutex mapping;         // Pins base and len, so sync_data() runs outside of lock
+    KeyTableCache tables;
+    std::unique_ptr<WriteAheadLog> wal;
+    ChainIndex index;
+
+    MappedAuthenticationServer(const MappedAuthenticationServer&) = delete;
+    MappedAuthenticationServer& operator=(const MappedAuthenticationServer&) = delete;
+
+    void map(const std::string &file, size_t capacity);
+    void unmap();
+    void grow();
+    StoreRecord* probe(uint64_t key) const;
+    StoreRecord* upsert(uint64_t key);
+    void apply(const WalRecord &rec);
+    static WalRecord counter_record(const StoreRecord &r);
+    void sync_data();
+
+public:
+    /**
+     * @param path The file, created by fetch() if it does not exist. Defaults to DEFAULT_STORE
+     * @param capacity Number of slots of a new file. Defaults to STORE_CAPACITY
+     * @param table_cache_size Capacity of the key table cache, see KeyTableCache
+     * @param logged Keep a write-ahead log at <path>.wal
+    */
+    MappedAuthenticationServer(const char *path = DEFAULT_STORE, size_t capacity = STORE_CAPACITY,
+                               size_t table_cache_size = KEY_TABLE_CACHE_SIZE, bool logged = true);
+    ~MappedAuthenticationServer();
+
+    /**
+     * Maps the file, creating it if necessary, and replays the log
+     * @throws Exception if the file cannot be mapped or is not a store
+    */
+    void fetch() override;
+
+    /**
+     * Writes all changes to disk, checkpointing the log
+    */
+    void sync() override;
+
+    void store(const MAC& base_mac, const ECP_Point& A, MAC& hashed_mac, int ctr) override;
+    QueryResult query(const MAC& hashed_mac, bool decrease_counter = true) override;
+
+    /**
+     * Rolls the lookahead window of the supplicant forward to hashed_mac, logging the
+     * new position like a counter decrement. The record is not committed, it becomes
+     * durable with the next commit of store() or query() or the next checkpoint.
+    */
+    void advance(const MAC& hashed_mac) override;
+    KeyTableCache* key_tables() override;
+
+    size_t size();
+    size_t capacity();
+
+    /**
+     * @return The counter of a record, -1 if there is none
+    */
+    int counter(const MAC& hashed_mac);
+};
+
+
+};  // namespace puf
+
+#endif  // __linux__
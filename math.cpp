@@ -5,6 +5,8 @@
 
 #include "errors.h"
 #include "statics.h"
+#include "ecp_arith.h"
+#include "fixed_base.h"
 
 namespace puf {
 
@@ -170,22 +172,24 @@ void ECP_Point::init() {
     memset(b64_buf, '\0', BASE64_LEN(65));
     olen = 0;
     b64_olen = 0;
+    encoded = false;
+    encoded64 = false;
     mbedtls_ecp_point_init(this);
 }
 
 
-ECP_Point::ECP_Point() : group(PUFStatics::instance().ecp_group()) {
+ECP_Point::ECP_Point() {
     init();
 }
 
 
-ECP_Point::ECP_Point(const ECP_Point &rhs) : group(PUFStatics::instance().ecp_group()) {
+ECP_Point::ECP_Point(const ECP_Point &rhs) {
     init();
     *this = rhs;
 }
 
 
-ECP_Point::ECP_Point(const mbedtls_ecp_point& p) : group(PUFStatics::instance().ecp_group()) {
+ECP_Point::ECP_Point(const mbedtls_ecp_point& p) {
     int err;
     init();
 #if MBEDTLS_VERSION_MAJOR >= 3
@@ -250,10 +254,17 @@ ECP_Point& ECP_Point::operator=(const ECP_Point &rhs) {
     }
 #endif
 
-    memcpy(buf, rhs.buf, rhs.olen);
-    memcpy(b64_buf, rhs.b64_buf, rhs.b64_olen);
-    olen = rhs.olen;
-    b64_olen = rhs.b64_olen;
+    // Take over cached encodings, if any
+    encoded = rhs.encoded;
+    encoded64 = rhs.encoded64;
+    if(encoded) {
+        memcpy(buf, rhs.buf, rhs.olen);
+        olen = rhs.olen;
+    }
+    if(encoded64) {
+        memcpy(b64_buf, rhs.b64_buf, rhs.b64_olen + 1);
+        b64_olen = rhs.b64_olen;
+    }
     return *this;
 }
 
@@ -265,8 +276,11 @@ ECP_Point ECP_Point::operator*(const MPI &rhs) const {
 
 ECP_Point& ECP_Point::operator*=(const MPI &rhs) {
     int err;
-    if( (err = mbedtls_ecp_mul(&group, this, &rhs, this, mbedtls_ctr_drbg_random, 
-        &PUFStatics::instance().ctr_drbg_context())) != 0) {
+    PUFStatics &statics = PUFStatics::instance();
+
+    // Scalars may be secret (t, a, c), mbedtls_ecp_mul() blinds the coordinates with the DRBG
+    if( (err = mbedtls_ecp_mul(&statics.ecp_group(), this, &rhs, this, mbedtls_ctr_drbg_random,
+        &statics.ctr_drbg_context())) != 0) {
         throw MathException(err);
     }
 
@@ -284,7 +298,7 @@ ECP_Point& ECP_Point::operator+=(const ECP_Point &rhs) {
     int err;
     const MPI one(1);
 
-    if( (err = mbedtls_ecp_muladd(&group, this, &one, this, &one, &rhs)) != 0) {
+    if( (err = mbedtls_ecp_muladd(&PUFStatics::instance().ecp_group(), this, &one, this, &one, &rhs)) != 0) {
         throw MathException(err);
     }
 
@@ -296,19 +310,46 @@ bool ECP_Point::operator==(const ECP_Point &rhs) {
     return (mbedtls_ecp_point_cmp(this, &rhs) == 0);
 }
 
+bool verify_muladd(const ECP_Point &S, const MPI &d, const ECP_Point &A, const ECP_Point &T,
+                   FixedBase *A_table) {
+    ECP_Arith &arith = PUFStatics::instance().ecp_arith();
+
+    if( A_table != NULL && A_table->enabled() && mbedtls_mpi_cmp_int(&d, 0) >= 0 &&
+        mbedtls_mpi_bitlen(&d) <= A_table->scalar_bits() ) {
+        ECP_PointVec R(1);
+        A_table->muladd_vartime(&R[0], &d, &T, arith);
+        return arith.equal(&R[0], &S);
+    }
+
+    const MPI one(1);
+    const mbedtls_mpi *m[2] = { &d, &one };
+    const mbedtls_ecp_point *P[2] = { &A, &T };
+    ECP_PointVec R(1);
+
+    arith.muladd_vartime(&R[0], m, P, 2);
+    return arith.equal(&R[0], &S);
+}
+
 size_t ECP_Point::len() const {
+    encode();
     return olen;
 }
 
 size_t ECP_Point::len64() const {
+    encode64();
     return b64_olen;
 }
 
 int ECP_Point::from_base64(const uint8_t* b64_buf_) {
     int err;
 
+    update();
     b64_olen = strlen( (char*)(b64_buf_) );
-    memcpy(b64_buf, b64_buf_, b64_olen);
+    if( b64_olen >= sizeof(b64_buf) ) {
+        b64_olen = 0;
+        throw MathException(MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL);
+    }
+    memcpy(b64_buf, b64_buf_, b64_olen + 1);
 
     if( (err = mbedtls_base64_decode(buf, 65, &olen, b64_buf, b64_olen)) != 0) {
         buf[0] = 0;
@@ -316,30 +357,41 @@ int ECP_Point::from_base64(const uint8_t* b64_buf_) {
         throw MathException(err);
     }
 
-    if( (err = mbedtls_ecp_point_read_binary(&group, this, buf, olen)) != 0) {
+    if( (err = mbedtls_ecp_point_read_binary(&PUFStatics::curve(), this, buf, olen)) != 0) {
         buf[0] = 0;
         b64_buf[0] = 0;
         throw MathException(err);
     }
+
+    // Both encodings are known already
+    encoded = true;
+    encoded64 = true;
     return 0;
 }
 
 int ECP_Point::from_binary(const uint8_t* buf_, size_t buflen) {
     int err;
-    if( (err = mbedtls_ecp_point_read_binary(&group, this, buf_, buflen)) != 0) {
+    update();
+    if( (err = mbedtls_ecp_point_read_binary(&PUFStatics::curve(), this, buf_, buflen)) != 0) {
         buf[0] = 0;
         b64_buf[0] = 0;
         throw MathException(err);
     }
-    update();
+
+    // The binary encoding is the input itself
+    memcpy(buf, buf_, buflen);
+    olen = buflen;
+    encoded = true;
     return 0;
 }
 
 const uint8_t* ECP_Point::base64() const {
+    encode64();
     return b64_buf;
 }
 
 const uint8_t* ECP_Point::binary() const {
+    encode();
     return buf;
 }
 
@@ -362,6 +414,7 @@ void ECP_Point::print() const {
 }
 
 void ECP_Point::print64() const {
+    encode64();
     for(size_t i=0; i<b64_olen; ++i) {
         printf("%c", static_cast<char>(b64_buf[i]) );
     }
@@ -369,14 +422,33 @@ void ECP_Point::print64() const {
 }
 
 void ECP_Point::update() {
+    encoded = false;
+    encoded64 = false;
+}
+
+void ECP_Point::encode() const {
     int err;
-    if( (err = mbedtls_ecp_point_write_binary(&group, this, MBEDTLS_ECP_PF_UNCOMPRESSED, &olen, buf, 65)) != 0) {
+    if(encoded) {
+        return;
+    }
+
+    if( (err = mbedtls_ecp_point_write_binary(&PUFStatics::curve(), this, MBEDTLS_ECP_PF_UNCOMPRESSED, &olen, buf, 65)) != 0) {
         throw MathException(err);
     }
+    encoded = true;
+}
+
+void ECP_Point::encode64() const {
+    int err;
+    if(encoded64) {
+        return;
+    }
 
+    encode();
     if( (err = mbedtls_base64_encode(b64_buf, BASE64_LEN(64), &b64_olen, buf, olen)) != 0) {
         throw MathException(err);
     }
+    encoded64 = true;
 }
 
 };  // namespace puf
\ No newline at end of file
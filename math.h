@@ -6,6 +6,8 @@
 
 namespace puf {
 
+class FixedBase;
+
 class MPI : public mbedtls_mpi {
 private:
     void init();
@@ -38,12 +40,16 @@ class ECP_Point : public mbedtls_ecp_point {
 private:
     void init();
     void update();
+    void encode() const;
+    void encode64() const;
 
-    uint8_t buf[65];
-    uint8_t b64_buf[ BASE64_LEN(65) ];
-    size_t olen;
-    size_t b64_olen;
-    mbedtls_ecp_group& group;
+    // Encodings are computed on first access and cached until the point changes
+    mutable uint8_t buf[65];
+    mutable uint8_t b64_buf[ BASE64_LEN(65) ];
+    mutable size_t olen;
+    mutable size_t b64_olen;
+    mutable bool encoded;
+    mutable bool encoded64;
 
 public:
     ECP_Point();
@@ -69,4 +75,14 @@ public:
     bool operator==(const ECP_Point &rhs);
 };
 
+
+/**
+ * Checks S == d*A + T by interleaved wNAF multiplication in variable time and
+ * compares without converting back to affine coordinates. Only for public
+ * inputs, e.g. the verification of a PUF_SYN_ACK.
+ * @param A_table Optional precomputed table of A, used if d fits into it
+*/
+bool verify_muladd(const ECP_Point &S, const MPI &d, const ECP_Point &A, const ECP_Point &T,
+                   FixedBase *A_table = NULL);
+
 };  // Namespace puf
\ No newline at end of file
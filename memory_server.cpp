@@ -0,0 +1,68 @@
+#include "memory_server.h"
+
+
+namespace puf {
+
+
+MemoryAuthenticationServer::MemoryAuthenticationServer(size_t table_cache_size) : tables(table_cache_size) { }
+
+
+void MemoryAuthenticationServer::fetch() { }
+
+
+void MemoryAuthenticationServer::sync() { }
+
+
+void MemoryAuthenticationServer::store(const MAC& base_mac, const ECP_Point& A, MAC& hashed_mac, int ctr) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = entries.find( hashed_mac.to_u64() );
+    if( it == entries.end() ) {
+        entries.emplace( hashed_mac.to_u64(), Entry{base_mac, A, ctr} );
+    } else {
+        it->second.base_mac = base_mac;
+        it->second.A = A;
+        it->second.ctr = ctr;
+    }
+    tables.erase(base_mac);
+}
+
+
+QueryResult MemoryAuthenticationServer::query(const MAC& hashed_mac, bool decrease_counter) {
+    std::lock_guard<std::mutex> guard(lock);
+    QueryResult r;
+    r.step = 0;
+    r.valid = false;
+
+    auto it = entries.find( hashed_mac.to_u64() );
+    if( it == entries.end() || it->second.ctr <= 0 ) {
+        return r;
+    }
+    if(decrease_counter) {
+        it->second.ctr--;
+    }
+    r.ecp = it->second.A;
+    r.mac = it->second.base_mac;
+    r.valid = true;
+    return r;
+}
+
+
+KeyTableCache* MemoryAuthenticationServer::key_tables() {
+    return &tables;
+}
+
+
+size_t MemoryAuthenticationServer::size() {
+    std::lock_guard<std::mutex> guard(lock);
+    return entries.size();
+}
+
+
+int MemoryAuthenticationServer::counter(const MAC& hashed_mac) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = entries.find( hashed_mac.to_u64() );
+    return it == entries.end() ? -1 : it->second.ctr;
+}
+
+
+};  // namespace puf
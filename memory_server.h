@@ -0,0 +1,48 @@
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+
+#include "platform.h"
+
+namespace puf {
+
+
+/**
+ * AuthenticationServer keeping its entries in memory only, e.g. for tests and
+ * benchmarks. fetch() and sync() do nothing. store() and query() are thread-safe.
+*/
+class MemoryAuthenticationServer : public AuthenticationServer {
+private:
+    typedef struct Entry {
+        MAC base_mac;
+        ECP_Point A;
+        int ctr;
+    } Entry;
+
+    std::unordered_map<uint64_t, Entry> entries;    // Keyed by hashed MAC
+    std::mutex lock;
+    KeyTableCache tables;
+
+public:
+    /**
+     * @param table_cache_size Capacity of the key table cache, see KeyTableCache
+    */
+    MemoryAuthenticationServer(size_t table_cache_size = KEY_TABLE_CACHE_SIZE);
+
+    void fetch() override;
+    void sync() override;
+    void store(const MAC& base_mac, const ECP_Point& A, MAC& hashed_mac, int ctr) override;
+    QueryResult query(const MAC& hashed_mac, bool decrease_counter = true) override;
+    KeyTableCache* key_tables() override;
+
+    size_t size();
+
+    /**
+     * @return The counter of an entry, -1 if there is none
+    */
+    int counter(const MAC& hashed_mac);
+};
+
+
+};  // namespace puf
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+namespace puf {
+
+
+/**
+ * Bounded lock-free queue for any number of producers and consumers, after
+ * D. Vyukov. Every slot carries a sequence number that tells whether the slot is
+ * free for the push or full for the pop of the current lap, so both claim a slot
+ * with one compare-and-swap and neither ever waits for the other. push() fails
+ * on a full queue instead of blocking.
+*/
+template<typename T>
+class MPMCQueue {
+private:
+    typedef struct alignas(64) Slot {
+        std::atomic<size_t> seq;
+        T value;
+    } Slot;
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head;       // Position of the next pop
+    alignas(64) std::atomic<size_t> tail;       // Position of the next push
+
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+public:
+    /**
+     * @param capacity Number of slots, rounded up to a power of two
+    */
+    MPMCQueue(size_t capacity) : mask(1), head(0), tail(0) {
+        while( mask < capacity ) {
+            mask <<= 1;
+        }
+        slots.reset(new Slot[mask]);
+        for(size_t i=0; i<mask; ++i) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+        mask--;
+    }
+
+    /**
+     * @return False if the queue is full
+    */
+    bool push(const T &value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for(;;) {
+            Slot &s = slots[pos & mask];
+            const intptr_t dif = static_cast<intptr_t>(s.seq.load(std::memory_order_acquire)) -
+                                 static_cast<intptr_t>(pos);
+            if( dif == 0 ) {
+                if( tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) ) {
+                    s.value = value;
+                    s.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if( dif < 0 ) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @return False if the queue is empty
+    */
+    bool pop(T &value) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for(;;) {
+            Slot &s = slots[pos & mask];
+            const intptr_t dif = static_cast<intptr_t>(s.seq.load(std::memory_order_acquire)) -
+                                 static_cast<intptr_t>(pos + 1);
+            if( dif == 0 ) {
+                if( head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) ) {
+                    value = s.value;
+                    s.seq.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if( dif < 0 ) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @return Number of queued values, exact only while no other thread pushes or pops
+    */
+    size_t size() const {
+        const size_t h = head.load(std::memory_order_relaxed);
+        const size_t t = tail.load(std::memory_order_relaxed);
+        return t > h ? t - h : 0;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+};
+
+
+};  // namespace puf
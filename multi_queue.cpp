@@ -0,0 +1,145 @@
+#include "multi_queue.h"
+
+#ifdef __linux__
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <chrono>
+
+
+namespace puf {
+
+
+/* Fanout group ids must differ between instances on the same interface */
+static std::atomic<unsigned> instances(0);
+
+
+MultiQueueAuthenticator::MultiQueueAuthenticator(const char *ifname, AuthenticationServer &as, size_t queues)
+    : as(as), running(false) {
+    if(queues == 0) {
+        queues = std::thread::hardware_concurrency();
+        queues = queues == 0 ? 1 : queues;
+    }
+
+    const uint16_t group = static_cast<uint16_t>(getpid() + instances.fetch_add(1));
+    for(size_t i=0; i<queues; ++i) {
+        std::unique_ptr<Queue> q(new Queue());
+        q->net.reset(new PacketRingNetwork(ifname));
+        q->net->join_fanout(group);
+        q->auth.reset(new Authenticator(*q->net, as));
+        q->stats.frames = 0;
+        q->stats.valid = 0;
+        q->stats.events = 0;
+        queues_.push_back(std::move(q));
+    }
+}
+
+
+MultiQueueAuthenticator::~MultiQueueAuthenticator() {
+    stop();
+}
+
+
+void MultiQueueAuthenticator::init() {
+    // Members are numbered in join order, which fanout_member() relies on
+    for(auto &q : queues_) {
+        q->net->init();
+        q->auth->switch_mac = SWITCH_MAC;
+    }
+    as.fetch();
+}
+
+
+void MultiQueueAuthenticator::start(EventHandler handler) {
+    if( running.exchange(true) ) {
+        return;
+    }
+    this->handler = handler;
+    for(size_t i=0; i<queues_.size(); ++i) {
+        queues_[i]->worker = std::thread(&MultiQueueAuthenticator::run, this, i);
+    }
+}
+
+
+void MultiQueueAuthenticator::stop() {
+    running = false;
+    for(auto &q : queues_) {
+        if( q->worker.joinable() ) {
+            q->worker.join();
+        }
+    }
+}
+
+
+void MultiQueueAuthenticator::run(size_t queue) {
+    Queue &q = *queues_[queue];
+    Frame frames[VALIDATE_BATCH_MAX];
+    std::vector<HandshakeEvent> events;
+    auto last_expire = std::chrono::steady_clock::now();
+
+    const unsigned cores = std::thread::hardware_concurrency();
+    if(cores > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(queue % cores, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    while( running.load(std::memory_order_relaxed) ) {
+        try {
+            size_t n = q.net->receive_in_place(frames, VALIDATE_BATCH_MAX, MULTI_QUEUE_POLL_MS);
+            uint64_t valid;
+
+            events.clear();
+            valid = q.auth->handle_burst(frames, n, events);
+            if( q.auth->batching ) {
+                q.auth->verify_queued(events, n == 0);
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            if( now - last_expire >= std::chrono::milliseconds(NETWORK_TIMEOUT_MS) ) {
+                q.auth->expire();
+                last_expire = now;
+            }
+
+            q.stats.frames.fetch_add(n, std::memory_order_relaxed);
+            q.stats.valid.fetch_add(__builtin_popcountll(valid), std::memory_order_relaxed);
+            q.stats.events.fetch_add(events.size(), std::memory_order_relaxed);
+            if(handler) {
+                for(const HandshakeEvent &ev : events) {
+                    handler(queue, ev);
+                }
+            }
+        } catch(const Exception &e) {
+            puts(e.what());
+        }
+    }
+}
+
+
+size_t MultiQueueAuthenticator::queues() const {
+    return queues_.size();
+}
+
+
+size_t MultiQueueAuthenticator::queue_of(const MAC &src_mac) const {
+    return PacketRingNetwork::fanout_member(src_mac, queues_.size());
+}
+
+
+Authenticator& MultiQueueAuthenticator::authenticator(size_t queue) {
+    return *queues_[queue]->auth;
+}
+
+
+const MultiQueueAuthenticator::QueueStats& MultiQueueAuthenticator::stats(size_t queue) const {
+    return queues_[queue]->stats;
+}
+
+
+};  // namespace puf
+
+#endif  // __linux__
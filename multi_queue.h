@@ -0,0 +1,109 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "authenticator.h"
+#include "packet_ring.h"
+
+namespace puf {
+
+
+/**
+ * Authenticator spread over several cores. Every queue owns a PacketRingNetwork, an
+ * Authenticator and a worker thread pinned to a core. The sockets form a
+ * PACKET_FANOUT group hashed on the source MAC, so all frames of one identity of a
+ * supplicant, i.e. its handshake and its data frames, reach the same worker, which
+ * keeps the sessions and hash chains of its identities to itself. The identities a
+ * supplicant moves on to along its MAC chain hash to other queues, so two workers
+ * may run handshakes of the same device at once.
+ *
+ * Workers take no common lock: PUFStatics is per thread, the tables of a
+ * KeyTableCache may be shared between threads, and the AuthenticationServer must be
+ * thread-safe, see AuthenticationServer.
+ * Registration is not handled, use a plain Authenticator for sign_up().
+*/
+class MultiQueueAuthenticator {
+public:
+    /**
+     * Called by the worker of a queue for every handshake event
+    */
+    typedef std::function<void(size_t queue, const HandshakeEvent&)> EventHandler;
+
+    /**
+     * Counters of a queue
+    */
+    typedef struct alignas(64) QueueStats {
+        std::atomic<uint64_t> frames;       // Received PUF-ACS frames
+        std::atomic<uint64_t> valid;        // Valid data frames
+        std::atomic<uint64_t> events;       // Handshake events
+    } QueueStats;
+
+private:
+    typedef struct Queue {
+        std::unique_ptr<PacketRingNetwork> net;
+        std::unique_ptr<Authenticator> auth;
+        std::thread worker;
+        QueueStats stats;
+    } Queue;
+
+    AuthenticationServer &as;
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::atomic<bool> running;
+    EventHandler handler;
+
+    MultiQueueAuthenticator(const MultiQueueAuthenticator&) = delete;
+    MultiQueueAuthenticator& operator=(const MultiQueueAuthenticator&) = delete;
+
+    void run(size_t queue);
+
+public:
+    /**
+     * @param ifname Name of the interface
+     * @param as Server shared by all queues, must be thread-safe
+     * @param queues Number of queues, 0 for one per core
+    */
+    MultiQueueAuthenticator(const char *ifname, AuthenticationServer &as, size_t queues = 0);
+    ~MultiQueueAuthenticator();
+
+    /**
+     * Opens the sockets of all queues and fetches the server entries
+     * @throws NetworkException if a socket cannot be set up
+    */
+    void init();
+
+    /**
+     * Starts the workers
+     * @param handler Receives the handshake events, may be empty
+    */
+    void start(EventHandler handler = EventHandler());
+
+    /**
+     * Stops the workers and waits for them, at most MULTI_QUEUE_POLL_MS
+    */
+    void stop();
+
+    size_t queues() const;
+
+    /**
+     * @return The queue handling frames of the given source MAC
+    */
+    size_t queue_of(const MAC &src_mac) const;
+
+    /**
+     * @return The Authenticator of a queue. Must not be used while the workers run
+    */
+    Authenticator& authenticator(size_t queue);
+
+    const QueueStats& stats(size_t queue) const;
+};
+
+
+};  // namespace puf
+
+#endif  // __linux__
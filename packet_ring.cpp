@@ -0,0 +1,384 @@
+#include "packet_ring.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+
+#include <chrono>
+
+
+namespace puf {
+
+
+/* Offset of the frame in a TX slot */
+static const size_t TX_DATA_OFFSET = TPACKET_ALIGN(sizeof(struct tpacket3_hdr));
+
+
+static int remaining_ms(const std::chrono::steady_clock::time_point& deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    return left.count() > 0 ? static_cast<int>(left.count()) : 0;
+}
+
+
+PacketRingNetwork::PacketRingNetwork(const char *ifname)
+    : fd(-1), ring(NULL), ring_len(0), rx_block(0), rx_frame(NULL), rx_left(0), rx_held(false), tx_next(0),
+      fanout_group(-1),
+      scratch(VALIDATE_BATCH_MAX * PACKET_RING_FRAME_SIZE) {
+    strncpy(this->ifname, ifname, sizeof(this->ifname) - 1);
+    this->ifname[sizeof(this->ifname) - 1] = 0;
+    memset(&rx_req, 0, sizeof(rx_req));
+    memset(&tx_req, 0, sizeof(tx_req));
+}
+
+
+PacketRingNetwork::~PacketRingNetwork() {
+    close_socket();
+}
+
+
+void PacketRingNetwork::close_socket() {
+    if(ring != NULL) {
+        munmap(ring, ring_len);
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+    fd = -1;
+    ring = NULL;
+    ring_len = 0;
+}
+
+
+void PacketRingNetwork::init() {
+    if(fd >= 0) {
+        return;
+    }
+
+    const unsigned ifindex = if_nametoindex(ifname);
+    if(ifindex == 0) {
+        throw NetworkException("PacketRing: Unknown interface");
+    }
+
+    // Protocol 0 receives nothing until bind(), so no frame passes by the filter
+    fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if(fd < 0) {
+        throw NetworkException("PacketRing: Could not open socket");
+    }
+
+    // A half set up socket would make the next init() return early
+    try {
+        setup(ifindex);
+    } catch(const NetworkException &e) {
+        close_socket();
+        throw;
+    }
+}
+
+
+void PacketRingNetwork::setup(unsigned ifindex) {
+    int version = TPACKET_V3;
+    if( setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0 ) {
+        throw NetworkException("PacketRing: TPACKET_V3 not supported");
+    }
+
+    // Handshakes, data frames and frames whose tag was stripped by the NIC
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, 12),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETHER_TYPE_PUF_ACS, 3, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETHER_TYPE_AD, 2, 0),
+        BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_VLAN_TAG_PRESENT)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0xffff),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct sock_fprog filter = {sizeof(code) / sizeof(code[0]), code};
+    if( setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) != 0 ) {
+        throw NetworkException("PacketRing: Could not attach filter");
+    }
+
+#ifdef PACKET_IGNORE_OUTGOING
+    // Own frames would otherwise show up in the RX ring, older kernels filter below
+    int one = 1;
+    setsockopt(fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+#ifdef PACKET_QDISC_BYPASS
+    int bypass = 1;
+    setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &bypass, sizeof(bypass));
+#endif
+
+    rx_req.tp_block_size = PACKET_RING_BLOCK_SIZE;
+    rx_req.tp_block_nr = PACKET_RING_BLOCKS;
+    rx_req.tp_frame_size = PACKET_RING_FRAME_SIZE;
+    rx_req.tp_frame_nr = (rx_req.tp_block_size / rx_req.tp_frame_size) * rx_req.tp_block_nr;
+    rx_req.tp_retire_blk_tov = PACKET_RING_RETIRE_MS;
+    if( setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &rx_req, sizeof(rx_req)) != 0 ) {
+        throw NetworkException("PacketRing: Could not set up RX ring");
+    }
+
+    // Slots are contiguous as the block size is a multiple of the frame size
+    const size_t per_block = PACKET_RING_BLOCK_SIZE / PACKET_RING_FRAME_SIZE;
+    tx_req.tp_block_size = PACKET_RING_BLOCK_SIZE;
+    tx_req.tp_block_nr = (PACKET_RING_TX_FRAMES + per_block - 1) / per_block;
+    tx_req.tp_frame_size = PACKET_RING_FRAME_SIZE;
+    tx_req.tp_frame_nr = per_block * tx_req.tp_block_nr;
+    if( setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &tx_req, sizeof(tx_req)) != 0 ) {
+        throw NetworkException("PacketRing: Could not set up TX ring");
+    }
+
+    // Both rings in one mapping, RX first
+    ring_len = static_cast<size_t>(rx_req.tp_block_size) * rx_req.tp_block_nr +
+               static_cast<size_t>(tx_req.tp_block_size) * tx_req.tp_block_nr;
+    void *map = mmap(NULL, ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if(map == MAP_FAILED) {
+        ring_len = 0;
+        throw NetworkException("PacketRing: Could not map rings");
+    }
+    ring = static_cast<uint8_t*>(map);
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = ifindex;
+    if( bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ) {
+        throw NetworkException("PacketRing: Could not bind to interface");
+    }
+
+    if(fanout_group >= 0) {
+        // Member index = bytes 2 to 5 of the source MAC modulo the group size
+        struct sock_filter demux[] = {
+            BPF_STMT(BPF_LD  | BPF_W | BPF_ABS, static_cast<uint32_t>(SKF_LL_OFF + 8)),
+            BPF_STMT(BPF_RET | BPF_A, 0),
+        };
+        struct sock_fprog prog = {sizeof(demux) / sizeof(demux[0]), demux};
+        int arg = fanout_group | (PACKET_FANOUT_CBPF << 16);
+        if( setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) != 0 ||
+            setsockopt(fd, SOL_PACKET, PACKET_FANOUT_DATA, &prog, sizeof(prog)) != 0 ) {
+            throw NetworkException("PacketRing: Could not join fanout group");
+        }
+    }
+}
+
+
+void PacketRingNetwork::join_fanout(uint16_t group) {
+    fanout_group = group;
+}
+
+
+size_t PacketRingNetwork::fanout_member(const MAC &src_mac, size_t members) {
+    const uint32_t h = static_cast<uint32_t>(src_mac.bytes[2]) << 24 | static_cast<uint32_t>(src_mac.bytes[3]) << 16 |
+                       static_cast<uint32_t>(src_mac.bytes[4]) << 8 | src_mac.bytes[5];
+    return members == 0 ? 0 : h % members;
+}
+
+
+struct tpacket_block_desc* PacketRingNetwork::block(size_t i) const {
+    return reinterpret_cast<struct tpacket_block_desc*>(ring + i * rx_req.tp_block_size);
+}
+
+
+bool PacketRingNetwork::next_block(int timeout_ms) {
+    struct tpacket_block_desc *bd = block(rx_block);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    while( (__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0 ) {
+        struct pollfd pfd = {fd, POLLIN | POLLERR, 0};
+        int r = poll(&pfd, 1, remaining_ms(deadline));
+        if(r < 0 && errno != EINTR) {
+            throw NetworkException("PacketRing: poll failed");
+        }
+        if(r == 0) {
+            return false;
+        }
+    }
+
+    rx_held = true;
+    rx_left = bd->hdr.bh1.num_pkts;
+    rx_frame = reinterpret_cast<struct tpacket3_hdr*>(reinterpret_cast<uint8_t*>(bd) + bd->hdr.bh1.offset_to_first_pkt);
+    return true;
+}
+
+
+void PacketRingNetwork::release_block() {
+    struct tpacket_block_desc *bd = block(rx_block);
+    __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    rx_block = (rx_block + 1) % rx_req.tp_block_nr;
+    rx_frame = NULL;
+    rx_left = 0;
+    rx_held = false;
+}
+
+
+size_t PacketRingNetwork::receive_in_place(Frame *frames, size_t n, int timeout_ms) {
+    if(fd < 0) {
+        throw NetworkException("PacketRing: Not initialised");
+    }
+    if(n > VALIDATE_BATCH_MAX) {
+        n = VALIDATE_BATCH_MAX;
+    }
+
+    size_t m = 0;
+    while(m == 0 && n > 0) {
+        if(rx_held && rx_left == 0) {
+            release_block();
+        }
+        if( !rx_held && !next_block(timeout_ms) ) {
+            break;
+        }
+
+        while(m < n && rx_left > 0) {
+            struct tpacket3_hdr *f = rx_frame;
+            const struct sockaddr_ll *sll = reinterpret_cast<const struct sockaddr_ll*>(
+                reinterpret_cast<uint8_t*>(f) + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)) );
+            uint8_t *data = reinterpret_cast<uint8_t*>(f) + f->tp_mac;
+            size_t len = f->tp_snaplen;
+
+            --rx_left;
+            rx_frame = reinterpret_cast<struct tpacket3_hdr*>(reinterpret_cast<uint8_t*>(f) + f->tp_next_offset);
+
+            if(sll->sll_pkttype == PACKET_OUTGOING || len < 14) {
+                continue;
+            }
+
+            // Put back the tag the NIC stripped
+            if(f->tp_status & TP_STATUS_VLAN_VALID) {
+                if(len + 4 > PACKET_RING_FRAME_SIZE) {
+                    continue;
+                }
+                const uint16_t tpid = (f->tp_status & TP_STATUS_VLAN_TPID_VALID) ? f->hv1.tp_vlan_tpid : ETH_P_8021Q;
+                const uint16_t tag[2] = {htons(tpid), htons(static_cast<uint16_t>(f->hv1.tp_vlan_tci))};
+                uint8_t *buf = scratch.data() + m * PACKET_RING_FRAME_SIZE;
+                memcpy(buf, data, 12);
+                memcpy(buf + 12, tag, 4);
+                memcpy(buf + 16, data + 12, len - 12);
+                data = buf;
+                len += 4;
+            }
+
+            const uint16_t type = ntohs( *reinterpret_cast<const uint16_t*>(data + 12) );
+            if(type != ETHER_TYPE_PUF_ACS && type != ETHER_TYPE_AD) {
+                continue;
+            }
+
+            frames[m].buf = data;
+            frames[m].len = len;
+            frames[m].size = len;
+            ++m;
+        }
+    }
+    return m;
+}
+
+
+int PacketRingNetwork::receive(uint8_t *buf, size_t bufSize) {
+    Frame f;
+    if( receive_in_place(&f, 1) == 0 ) {
+        return -1;
+    }
+    const size_t len = f.len < bufSize ? f.len : bufSize;
+    memcpy(buf, f.buf, len);
+    return static_cast<int>(len);
+}
+
+
+size_t PacketRingNetwork::receive_batch(Frame *frames, size_t n) {
+    Frame in_place[VALIDATE_BATCH_MAX];
+    n = receive_in_place(in_place, n);
+    for(size_t i=0; i<n; ++i) {
+        frames[i].len = in_place[i].len < frames[i].size ? in_place[i].len : frames[i].size;
+        memcpy(frames[i].buf, in_place[i].buf, frames[i].len);
+    }
+    return n;
+}
+
+
+uint8_t* PacketRingNetwork::tx_slot() {
+    if(fd < 0) {
+        throw NetworkException("PacketRing: Not initialised");
+    }
+
+    uint8_t *slot = ring + static_cast<size_t>(rx_req.tp_block_size) * rx_req.tp_block_nr + tx_next * tx_req.tp_frame_size;
+    struct tpacket3_hdr *h = reinterpret_cast<struct tpacket3_hdr*>(slot);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(NETWORK_TIMEOUT_MS);
+
+    for(;;) {
+        const uint32_t status = __atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE);
+        if(status == TP_STATUS_AVAILABLE || status == TP_STATUS_WRONG_FORMAT) {
+            return slot;
+        }
+
+        // Ring full: hand the pending frames to the kernel and wait for a free slot
+        flush();
+        struct pollfd pfd = {fd, POLLOUT | POLLERR, 0};
+        int r = poll(&pfd, 1, remaining_ms(deadline));
+        if(r < 0 && errno != EINTR) {
+            throw NetworkException("PacketRing: poll failed");
+        }
+        if(r == 0) {
+            throw NetworkException("PacketRing: TX ring full");
+        }
+    }
+}
+
+
+void PacketRingNetwork::tx_commit(uint8_t *slot, size_t len) {
+    struct tpacket3_hdr *h = reinterpret_cast<struct tpacket3_hdr*>(slot);
+    h->tp_len = len;
+    h->tp_snaplen = len;
+    h->tp_next_offset = 0;
+    __atomic_store_n(&h->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    tx_next = (tx_next + 1) % tx_req.tp_frame_nr;
+}
+
+
+void PacketRingNetwork::flush() {
+    if( ::send(fd, NULL, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != ENOBUFS && errno != EINTR ) {
+        throw NetworkException("PacketRing: send failed");
+    }
+}
+
+
+void PacketRingNetwork::send(uint8_t *buf, size_t bufSize) {
+    send_gather(buf, bufSize, NULL, 0);
+}
+
+
+void PacketRingNetwork::send_gather(const uint8_t *header, size_t header_len, const uint8_t *data, size_t data_len) {
+    if( header_len + data_len > PACKET_RING_FRAME_SIZE - TX_DATA_OFFSET ) {
+        throw NetworkException("Frame too large");
+    }
+    uint8_t *slot = tx_slot();
+    memcpy(slot + TX_DATA_OFFSET, header, header_len);
+    if(data_len > 0) {
+        memcpy(slot + TX_DATA_OFFSET + header_len, data, data_len);
+    }
+    tx_commit(slot, header_len + data_len);
+    flush();
+}
+
+
+size_t PacketRingNetwork::send_batch(const Frame *frames, size_t n) {
+    for(size_t i=0; i<n; ++i) {
+        if( frames[i].len > PACKET_RING_FRAME_SIZE - TX_DATA_OFFSET ) {
+            throw NetworkException("Frame too large");
+        }
+        uint8_t *slot = tx_slot();
+        memcpy(slot + TX_DATA_OFFSET, frames[i].buf, frames[i].len);
+        tx_commit(slot, frames[i].len);
+    }
+    flush();
+    return n;
+}
+
+
+};  // namespace puf
+
+#endif  // __linux__
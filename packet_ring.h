@@ -0,0 +1,117 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <vector>
+#include <net/if.h>                 // IFNAMSIZ
+#include <linux/if_packet.h>
+
+#include "platform.h"
+
+namespace puf {
+
+
+/**
+ * Network on a Linux AF_PACKET socket with memory mapped TPACKET_V3 rings. Received
+ * frames are collected by the kernel in blocks, which are handed back once all their
+ * frames are consumed. Frames are sent from a ring of fixed size slots and flushed
+ * with one syscall per send(), send_gather() or send_batch().
+ *
+ * Only PUF-ACS frames are received, i.e. handshakes (ETHER_TYPE_PUF_ACS) and tagged
+ * data frames (ETHER_TYPE_AD). Requires CAP_NET_RAW.
+*/
+class PacketRingNetwork : public Network {
+private:
+    char ifname[IFNAMSIZ];
+    int fd;
+    uint8_t *ring;
+    size_t ring_len;
+    struct tpacket_req3 rx_req;
+    struct tpacket_req3 tx_req;
+
+    size_t rx_block;                    // Block currently read
+    struct tpacket3_hdr *rx_frame;      // Next frame in the current block
+    uint32_t rx_left;                   // Frames left in the current block, 0 if none is held
+    bool rx_held;                       // The current block belongs to user space
+
+    size_t tx_next;                     // Next slot of the TX ring
+
+    int fanout_group;                   // PACKET_FANOUT group to join, -1 for none
+
+    std::vector<uint8_t> scratch;       // Frames whose VLAN tag was stripped by the NIC
+
+    PacketRingNetwork(const PacketRingNetwork&) = delete;
+    PacketRingNetwork& operator=(const PacketRingNetwork&) = delete;
+
+    void setup(unsigned ifindex);
+    void close_socket();
+
+    struct tpacket_block_desc* block(size_t i) const;
+    bool next_block(int timeout_ms);
+    void release_block();
+
+    uint8_t* tx_slot();
+    void tx_commit(uint8_t *slot, size_t len);
+    void flush();
+
+public:
+    /**
+     * @param ifname Name of the interface, e.g. "eth0"
+    */
+    PacketRingNetwork(const char *ifname);
+    ~PacketRingNetwork();
+
+    /**
+     * Opens the socket, sets up and maps the rings and binds to the interface
+     * @throws NetworkException on failure
+    */
+    void init() override;
+
+    /**
+     * Joins a PACKET_FANOUT group on init(), which spreads received frames over the
+     * sockets of the group by source MAC, see fanout_member(). All sockets of a group
+     * must join before frames arrive. Call before init().
+     * @param group Id of the group, unique per interface and process
+    */
+    void join_fanout(uint16_t group);
+
+    /**
+     * @param src_mac Source MAC of a frame
+     * @param members Number of sockets in the group
+     * @return Index of the socket in join order a fanout group delivers the frame to
+    */
+    static size_t fanout_member(const MAC &src_mac, size_t members);
+
+    void send(uint8_t *buf, size_t bufSize) override;
+    void send_gather(const uint8_t *header, size_t header_len, const uint8_t *data, size_t data_len) override;
+    size_t send_batch(const Frame *frames, size_t n) override;
+
+    /**
+     * Copies the next frame into buf, waits up to NETWORK_TIMEOUT_MS
+     * @return The length of the frame, -1 on timeout
+    */
+    int receive(uint8_t *buf, size_t bufSize) override;
+    size_t receive_batch(Frame *frames, size_t n) override;
+
+    /**
+     * Receives frames without copying them, buf of each frame points into the ring.
+     * The frames stay valid until the next call of receive_in_place(), receive() or
+     * receive_batch(), which may hand their block back to the kernel. Only frames
+     * whose VLAN tag the NIC stripped are copied to reinsert the tag.
+     * @param frames Receive buf and len of the frames, size is set to len
+     * @param n Maximum number of frames, at most VALIDATE_BATCH_MAX
+     * @param timeout_ms Time to wait for the first frame
+     * @return Number of frames received
+    */
+    size_t receive_in_place(Frame *frames, size_t n, int timeout_ms = NETWORK_TIMEOUT_MS);
+
+    /**
+     * @return The socket, e.g. to poll() on it
+    */
+    int socket_fd() const {return fd;}
+};
+
+
+};  // namespace puf
+
+#endif  // __linux__
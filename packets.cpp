@@ -1,7 +1,7 @@
 #include "packets.h"
 #include "errors.h"
 
-#include <mbedtls/sha256.h>
+#include "sha256_fixed.h"
 
 
 namespace puf {
@@ -27,15 +27,9 @@ packet_type_e deduce_type(const uint8_t *buf, size_t bufLen) {
 
 
 void MAC::hash(int iterations) {
-    static unsigned char output[32];
+    uint8_t output[32];
     for(int i=0; i<iterations; ++i) {
-#if MBEDTLS_VERSION_MAJOR >= 3
-        if( mbedtls_sha256(bytes, 6, output, 0) ) {
-#else
-        if( mbedtls_sha256_ret(bytes, 6, output, 0) ) {
-#endif
-            throw PacketException("Error SHA256");
-        }
+        sha256_mac(bytes, output);
         memcpy(bytes, output, 6);
     }
 }
@@ -192,8 +186,13 @@ void PUF_SYN_ACK::from_binary(uint8_t *buffer, size_t buflen) {
 }
 
 
-void PUF_Performance::calc() {
+PUF_Performance::PUF_Performance() : frame_len(ETHER_MIN_FRAME_LEN) {
     memset(&header, 0, sizeof(header));
+}
+
+
+void PUF_Performance::calc() {
+    memset(&header.U, 0, sizeof(header.U));
     memcpy(header.U.src_mac, src_mac.bytes, 6);
     memcpy(header.U.dst_mac, dst_mac.bytes, 6);
     memcpy(header.U.q_header, &ETH_Q, sizeof(header.U.q_header) );
@@ -226,26 +225,99 @@ uint8_t* PUF_Performance::get_data() {
 }
 
 
+void PUF_Performance::set_data(const uint8_t *data, size_t n) {
+    if( n > sizeof(header.data) - sizeof(header.U) ) {
+        throw PacketException("PUF_Performance: Data too large");
+    }
+
+    if( n > 0 ) {
+        memcpy(get_data(), data, n);
+    }
+    frame_len = sizeof(header.U) + n;
+
+    // Pad short frames
+    if( frame_len < ETHER_MIN_FRAME_LEN ) {
+        memset(header.data + frame_len, 0, ETHER_MIN_FRAME_LEN - frame_len);
+        frame_len = ETHER_MIN_FRAME_LEN;
+    }
+}
+
+
 void PUF_Performance::from_binary(uint8_t *buffer, size_t buflen) {
     // Buffer checks
     if(!buffer) {
         throw PacketException("Buffer must not be NULL");
     }
-    if(buflen < 64 || buflen > ETHER_FRAME_LEN) {
+    if(buflen < ETHER_MIN_FRAME_LEN || buflen > ETHER_FRAME_LEN) {
         throw PacketException("PUF_Performance: Wrong buffer size");
     }
 
     // Integrity check
     memcpy(header.data, buffer, buflen);
     if( memcmp( header.U.q_header, &ETH_Q, sizeof(header.U.q_header)) != 0 ||
-        memcmp( header.U.ad_header, &ETH_AD, sizeof(header.U.ad_header) != 0)) 
+        memcmp( header.U.ad_header, &ETH_AD, sizeof(header.U.ad_header)) != 0) 
     {
-        memset(header.data, 0, sizeof(header.data));
+        memset(&header.U, 0, sizeof(header.U));
+        frame_len = ETHER_MIN_FRAME_LEN;
         throw PacketException("Faulty header types");
     }
+    frame_len = buflen;
 
     memcpy(src_mac.bytes, header.U.src_mac, sizeof(src_mac.bytes));
     memcpy(dst_mac.bytes, header.U.dst_mac, sizeof(dst_mac.bytes));
 }
 
+
+PUF_PerformanceView PUF_Performance::view() const {
+    PUF_PerformanceView v;
+    v.from_binary(header.data, frame_len);
+    return v;
+}
+
+
+PUF_PerformanceView::PUF_PerformanceView() : buf(NULL), buflen(0) {}
+
+
+bool PUF_PerformanceView::check(const uint8_t *buffer, size_t buflen) {
+    if( buffer == NULL || buflen < ETHER_MIN_FRAME_LEN || buflen > ETHER_FRAME_LEN ) {
+        return false;
+    }
+
+    const PUF_Performance_Header *h = reinterpret_cast<const PUF_Performance_Header*>(buffer);
+    return memcmp( h->q_header, &ETH_Q, sizeof(h->q_header) ) == 0 &&
+           memcmp( h->ad_header, &ETH_AD, sizeof(h->ad_header) ) == 0;
+}
+
+
+void PUF_PerformanceView::from_binary(const uint8_t *buffer, size_t buflen_) {
+    if( !check(buffer, buflen_) ) {
+        throw PacketException("PUF_Performance: Faulty frame");
+    }
+    buf = buffer;
+    buflen = buflen_;
+}
+
+
+MAC PUF_PerformanceView::src_mac() const {
+    MAC mac;
+    memcpy(mac.bytes, reinterpret_cast<const PUF_Performance_Header*>(buf)->src_mac, sizeof(mac.bytes));
+    return mac;
+}
+
+
+MAC PUF_PerformanceView::dst_mac() const {
+    MAC mac;
+    memcpy(mac.bytes, reinterpret_cast<const PUF_Performance_Header*>(buf)->dst_mac, sizeof(mac.bytes));
+    return mac;
+}
+
+
+VLAN_Payload PUF_PerformanceView::get_payload() const {
+    const PUF_Performance_Header *h = reinterpret_cast<const PUF_Performance_Header*>(buf);
+    VLAN_Payload retval;
+    memcpy(&retval.load1, h->vlan_buf_1, sizeof(retval.load1));
+    memcpy(&retval.load2, h->vlan_buf_2, sizeof(retval.load2));
+    return retval;
+}
+
 };  // namespace puf
\ No newline at end of file
@@ -129,33 +129,115 @@ public:
 };
 
 
+/* Header of a PUF_Performance frame, an Ethernet header with a 802.1ad and a
+ * 802.1Q tag carrying the hash chain */
+typedef struct __attribute__((__packed__)) PUF_Performance_Header {
+    uint8_t dst_mac[6];
+    uint8_t src_mac[6];
+    uint8_t ad_header[2];
+    uint8_t vlan_buf_1[2];
+    uint8_t q_header[2];
+    uint8_t vlan_buf_2[2];
+    uint8_t ether_type[2];
+} PUF_Performance_Header;
+
+
+/* Bytes to reserve in front of the data for the header of a PUF_Performance frame */
+const size_t PUF_PERFORMANCE_HEADROOM = sizeof(PUF_Performance_Header);
+
+
+class PUF_PerformanceView;
+
+
 class PUF_Performance {
     typedef union {
-        struct __attribute__((__packed__)) {
-            uint8_t dst_mac[6];
-            uint8_t src_mac[6];
-            uint8_t ad_header[2];
-            uint8_t vlan_buf_1[2];
-            uint8_t q_header[2];
-            uint8_t vlan_buf_2[2];
-            uint8_t ether_type[2];
-        } U;
+        PUF_Performance_Header U;
         uint8_t data[ETHER_FRAME_LEN];
     } Header_t;
 
     Header_t header;
+    size_t frame_len;
 
 public:
     MAC src_mac, dst_mac;
 
+    PUF_Performance();
+
     void calc();
     void from_binary(uint8_t*, size_t);
     uint8_t* binary();
     constexpr size_t header_len() {return sizeof(Header_t);}
 
+    /**
+     * @return Length of the frame on the wire, i.e. header, data and padding
+    */
+    size_t len() const {return frame_len;}
+
+    /**
+     * @return Length of the data, including the padding of short frames
+    */
+    size_t data_len() const {return frame_len - sizeof(PUF_Performance_Header);}
+
     uint8_t* get_data();
+
+    /**
+     * Copies data behind the header and sets the length of the frame, padded to
+     * ETHER_MIN_FRAME_LEN
+     * @param data The data, may be NULL if n is 0
+     * @param n Length of the data
+     * @throws PacketException if the data does not fit into a frame
+    */
+    void set_data(const uint8_t *data, size_t n);
+
     void set_payload(const VLAN_Payload load);
     VLAN_Payload get_payload() const;
+
+    /**
+     * @return A view of the whole frame
+     * @throws PacketException if the header has not been set, see calc()
+    */
+    PUF_PerformanceView view() const;
+};
+
+
+/**
+ * Non-owning view of a received PUF_Performance frame. Checks the header in place
+ * and reads it without copying the frame. The buffer must outlive the view.
+*/
+class PUF_PerformanceView {
+private:
+    const uint8_t *buf;
+    size_t buflen;
+
+public:
+    PUF_PerformanceView();
+
+    /**
+     * Checks the header of a frame without wrapping it
+     * @return True if the buffer holds a PUF_Performance frame
+    */
+    static bool check(const uint8_t *buffer, size_t buflen);
+
+    /**
+     * Wraps a frame
+     * @param buffer The received frame
+     * @param buflen Length of the frame
+     * @throws PacketException if the buffer does not hold a PUF_Performance frame
+    */
+    void from_binary(const uint8_t *buffer, size_t buflen);
+
+    const uint8_t* binary() const {return buf;}
+    size_t len() const {return buflen;}
+
+    MAC src_mac() const;
+    MAC dst_mac() const;
+    VLAN_Payload get_payload() const;
+
+    /**
+     * @return The user data following the header
+    */
+    const uint8_t* get_data() const {return buf + sizeof(PUF_Performance_Header);}
+    size_t data_len() const {return buflen - sizeof(PUF_Performance_Header);}
 };
 
 
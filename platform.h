@@ -1,9 +1,22 @@
 #pragma once
 
 #include "packets.h"
+#include "errors.h"
+#include "key_table_cache.h"
 
 namespace puf {
 
+
+/**
+ * A frame of a batch passed to the Network
+*/
+typedef struct Frame {
+    uint8_t *buf;       // Frame buffer
+    size_t len;         // Length of the frame
+    size_t size;        // Size of the buffer, relevant for receiving only
+} Frame;
+
+
 class Network {
 public:
 
@@ -19,6 +32,60 @@ public:
     */
     virtual void send(uint8_t *buf, size_t bufSize) = 0;
 
+    /**
+     * Sends one frame made of a header and data in separate buffers, e.g. via
+     * sendmsg() with two iovecs. The default implementation joins both in a
+     * buffer and calls send().
+     * @param header The first bytes of the frame
+     * @param header_len Length of the header
+     * @param data The remaining bytes of the frame
+     * @param data_len Length of the data
+    */
+    virtual void send_gather(const uint8_t *header, size_t header_len, const uint8_t *data, size_t data_len) {
+        uint8_t buf[ETHER_FRAME_LEN];
+        if( header_len + data_len > sizeof(buf) ) {
+            throw NetworkException("Frame too large");
+        }
+        memcpy(buf, header, header_len);
+        memcpy(buf + header_len, data, data_len);
+        send(buf, header_len + data_len);
+    }
+
+    /**
+     * Sends several frames at once, e.g. via sendmmsg(). The default implementation
+     * calls send() per frame.
+     * @param frames The frames, buf and len of each must be set
+     * @param n Number of frames
+     * @return Number of frames sent
+    */
+    virtual size_t send_batch(const Frame *frames, size_t n) {
+        for(size_t i=0; i<n; ++i) {
+            send(frames[i].buf, frames[i].len);
+        }
+        return n;
+    }
+
+    /**
+     * Receives several frames at once, e.g. via recvmmsg(). Waits for the first
+     * frame only. The default implementation calls receive() once, as it cannot
+     * tell whether more frames are pending.
+     * @param frames Buffers to receive into, buf and size of each must be set. len
+     *               is set to the length of the received frame
+     * @param n Maximum number of frames
+     * @return Number of frames received
+    */
+    virtual size_t receive_batch(Frame *frames, size_t n) {
+        if(n == 0) {
+            return 0;
+        }
+        int r = receive(frames[0].buf, frames[0].size);
+        if(r <= 0) {
+            return 0;
+        }
+        frames[0].len = r;
+        return 1;
+    }
+
     /**
      * Attempts to receive a message via the network
      * @param buf The buffer which the message is written into
@@ -50,11 +117,19 @@ public:
 typedef struct QueryResult {
     ECP_Point ecp;
     MAC mac;
+    uint32_t step;              // Position of the queried MAC in the chain of the supplicant, 0 if not tracked
     bool valid;
     operator bool() const {return valid;}
 } QueryResult;
 
 
+/**
+ * Store of the registered supplicants. A server used by a single Authenticator is
+ * only called from its thread. A server shared by several threads, e.g. by a
+ * HandshakeExecutor or a MultiQueueAuthenticator, must allow query(), advance(),
+ * store() and key_tables() to be called concurrently, and the KeyTableCache it
+ * returns is then used by all of these threads as well.
+*/
 class AuthenticationServer {
 public:
 
@@ -87,6 +162,22 @@ public:
      * @return Pair of A and base mac. Empty optional if access is denied
     */
     virtual QueryResult query(const MAC& hashed_mac, bool decrease_counter = true) = 0;
+
+    /**
+     * Records that a supplicant proved its identity under hashed_mac, so that the
+     * server may move on along its MAC chain. Must only be called once the
+     * PUF_SYN_ACK of the handshake is verified, never on a mere query(), as the
+     * MACs of a supplicant are sent in clear. The default implementation does nothing.
+     *
+     * @param hashed_mac The MAC the supplicant authenticated with
+    */
+    virtual void advance(const MAC& /*hashed_mac*/) {}
+
+    /**
+     * Optional cache of precomputed tables of the public keys A returned by query()
+     * @return The cache or NULL if the server keeps none
+    */
+    virtual KeyTableCache* key_tables() {return NULL;}
 };
 
 };
\ No newline at end of file
@@ -0,0 +1,230 @@
+#include "session.h"
+#include "statics.h"
+#include "errors.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+namespace puf {
+
+
+Session::Session() : opened_ms(0), pending(false), verifying(false), connected(false) {
+    memset(base_mac.bytes, 0, sizeof(base_mac.bytes));
+    memset(remote_mac.bytes, 0, sizeof(remote_mac.bytes));
+}
+
+
+SessionTable::SessionTable(size_t capacity) : capacity_(capacity) {
+    table.reserve(capacity);
+}
+
+
+Session* SessionTable::find(const MAC& remote_mac) {
+    auto it = table.find( remote_mac.to_u64() );
+    return it == table.end() ? NULL : &it->second;
+}
+
+
+Session* SessionTable::emplace(const Session& handshake, uint32_t now_ms) {
+    const uint64_t key = handshake.remote_mac.to_u64();
+    auto it = table.find(key);
+    bool connected = false, restart = true;
+
+    if( it == table.end() ) {
+        if( table.size() >= capacity_ ) {
+            return NULL;
+        }
+        it = table.emplace(key, Session()).first;
+    } else {
+        connected = it->second.connected;
+
+        // Repeated PUF_CON, the handshake has one entry in pending already
+        if( it->second.pending && !it->second.verifying ) {
+            restart = false;
+            now_ms = it->second.opened_ms;
+        }
+    }
+
+    Session &s = it->second;
+    s = handshake;
+    s.opened_ms = now_ms;
+    s.pending = true;
+    s.verifying = false;
+    s.connected = connected;
+    if(restart) {
+        pending.push_back( {key, now_ms, now_ms} );
+    }
+    return &s;
+}
+
+
+void SessionTable::reject(const MAC& remote_mac) {
+    auto it = table.find( remote_mac.to_u64() );
+    if( it == table.end() ) {
+        return;
+    }
+    if( !it->second.connected ) {
+        table.erase(it);
+        return;
+    }
+    it->second.pending = false;
+    it->second.verifying = false;
+}
+
+
+void SessionTable::erase(const MAC& remote_mac) {
+    table.erase( remote_mac.to_u64() );
+}
+
+
+size_t SessionTable::expire(uint32_t now_ms, uint32_t timeout_ms, ChainTable *chains, uint32_t idle_ms) {
+    size_t n = 0;
+
+    while( !pending.empty() && now_ms - pending.front().since_ms >= timeout_ms ) {
+        Pending p = pending.front();
+        pending.pop_front();
+
+        // Session may have been restarted or removed in the meantime
+        auto it = table.find(p.key);
+        if( it == table.end() || it->second.opened_ms != p.opened_ms ) {
+            continue;
+        }
+        if( !it->second.connected ) {
+            if( it->second.pending ) {
+                table.erase(it);
+                n++;
+            }
+            continue;
+        }
+
+        // A connected session keeps its flow and is watched from now on
+        it->second.pending = false;
+        it->second.verifying = false;
+        if( chains != NULL ) {
+            p.since_ms = now_ms;
+            idle.push_back(p);
+        }
+    }
+
+    while( chains != NULL && !idle.empty() && now_ms - idle.front().since_ms >= idle_ms ) {
+        Pending p = idle.front();
+        idle.pop_front();
+
+        auto it = table.find(p.key);
+        if( it == table.end() || it->second.opened_ms != p.opened_ms ) {
+            continue;
+        }
+
+        // Still in use, check again in idle_ms
+        ChainState *c = chains->find(it->second.remote_mac);
+        if( c != NULL && now_ms - c->seen_ms < idle_ms ) {
+            p.since_ms = now_ms;
+            idle.push_back(p);
+            continue;
+        }
+
+        if( c != NULL ) {
+            chains->erase(it->second.remote_mac);
+        }
+        table.erase(it);
+        n++;
+    }
+
+    return n;
+}
+
+
+size_t SessionTable::size() const {
+    return table.size();
+}
+
+
+size_t SessionTable::capacity() const {
+    return capacity_;
+}
+
+
+int PUF_CON_phase(Session &s, const PUF_CON &puf_con, AuthenticationServer &as) {
+    // Query for hashed mac
+    auto q = as.query(puf_con.src_mac);
+    if(!q) {
+        puts("Query did not yield result");
+        return 1;
+    }
+    s.base_mac = q.mac;
+    s.A = q.ecp;
+    s.T = puf_con.T;
+
+    // Precomputed table of A, verification falls back to plain arithmetic without it
+    KeyTableCache *tables = as.key_tables();
+    if( tables != NULL ) {
+        try {
+            s.A_table = tables->get(s.base_mac, s.A);
+        } catch(const MathException &e) {
+            puts(e.what());
+        }
+    }
+    return 0;
+}
+
+
+int PUF_SYN_phase(Session &s, const MAC &switch_mac, PUFStatics &statics, PUF_SYN &puf_syn) {
+    ECP_Point G(statics.ecp_group().G);
+    MPI c;
+
+    puf_syn.pc = s.base_mac;            // Set PUF Challenge
+    puf_syn.dst_mac = s.remote_mac;     // Set remote MAC
+    puf_syn.src_mac = switch_mac;       // Set source MAC
+
+    try {
+        // d fills the 4 bytes of PUF_SYN, c is a full scalar. Both come from the DRBG
+        // of this thread, which takes no lock.
+        do {
+            MATH_CHK( mbedtls_mpi_fill_random(&puf_syn.d, sizeof(uint32_t), mbedtls_ctr_drbg_random,
+                                              &statics.ctr_drbg_context()) );
+        } while( mbedtls_mpi_cmp_int(&puf_syn.d, 0) == 0 );
+        s.d = puf_syn.d;
+        MATH_CHK( mbedtls_ecp_gen_privkey(&statics.ecp_group(), &c, mbedtls_ctr_drbg_random,
+                                          &statics.ctr_drbg_context()) );
+
+        puf_syn.C = G*c;                    // Calc C
+        ECP_Point K = s.T*c;                // Calc K (required for k = K.x)
+#if MBEDTLS_VERSION_MAJOR >= 3
+        s.k = K.private_X;                  // Calc k
+        puf_syn.pc ^= s.k.private_p;        // Calc pc
+#else 
+        s.k = K.X;                          // Calc k
+        puf_syn.pc ^= s.k.p;                // Calc pc
+#endif
+    } catch(const MathException &e) {
+        puts(e.what());
+        return 1;
+    }
+
+    puf_syn.calc();                     // Build package
+    return 0;
+}
+
+
+bool PUF_ACK_phase(const Session &s, const PUF_SYN_ACK &puf_syn_ack) {
+    // S == A*d + T, all values are public
+    try {
+        return verify_muladd(puf_syn_ack.S, s.d, s.A, s.T, s.A_table.get());
+    } catch(const MathException &e) {
+        puts(e.what());
+        return false;
+    }
+}
+
+
+const uint8_t* chain_key(const Session &s) {
+#if MBEDTLS_VERSION_MAJOR >= 3
+    return reinterpret_cast<const uint8_t*>(s.k.private_p);
+#else
+    return reinterpret_cast<const uint8_t*>(s.k.p);
+#endif
+}
+
+
+};  // namespace puf
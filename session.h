@@ -0,0 +1,154 @@
+#pragma once
+
+#include <unordered_map>
+#include <deque>
+#include <memory>
+
+#include "packets.h"
+#include "platform.h"
+#include "chain_table.h"
+#include "math.h"
+#include "fixed_base.h"
+
+namespace puf {
+
+
+class PUFStatics;
+
+
+/**
+ * Handshake and hash chain state of a single supplicant, as seen by the Authenticator.
+*/
+typedef struct Session {
+    MAC base_mac;               // Base MAC as stored by the AuthenticationServer
+    MAC remote_mac;             // Current (hashed) MAC of the supplicant
+    ECP_Point A;                // Public key A of the supplicant
+    std::shared_ptr<FixedBase> A_table;     // Precomputed table of A, if cached by the AuthenticationServer
+    ECP_Point T;                // Commitment T from PUF_CON
+    MPI d;                      // Challenge d sent in PUF_SYN
+    MPI k;                      // Shared secret k = K.x
+    uint32_t opened_ms;         // Time the PUF_CON was received
+    bool pending;               // PUF_SYN sent, PUF_SYN_ACK not yet verified
+    bool verifying;             // PUF_SYN_ACK queued for batch verification
+    bool connected;             // A handshake was verified, the flow is open
+
+    Session();
+} Session;
+
+
+class SessionTable {
+private:
+    typedef struct Pending {
+        uint64_t key;
+        uint32_t opened_ms;
+        uint32_t since_ms;              // Time the entry was queued
+    } Pending;
+
+    std::unordered_map<uint64_t, Session> table;
+    std::deque<Pending> pending;        // Handshakes in order of their start
+    std::deque<Pending> idle;           // Connected sessions in order of their last check
+    size_t capacity_;
+
+public:
+    /**
+     * @param capacity Maximum number of concurrent sessions. Defaults to MAX_SESSIONS
+    */
+    SessionTable(size_t capacity = MAX_SESSIONS);
+    SessionTable(const SessionTable&) = delete;
+    SessionTable& operator=(const SessionTable&) = delete;
+
+    /**
+     * Looks up the session of a supplicant
+     * @param remote_mac The (hashed) source MAC of the supplicant
+     * @return The session or NULL if there is none
+    */
+    Session* find(const MAC& remote_mac);
+
+    /**
+     * Starts the handshake of a supplicant. An existing session of the same supplicant
+     * takes the new handshake, but stays connected until it is verified, so a forged
+     * PUF_CON does not end the flow. Repeating a PUF_CON before the PUF_SYN_ACK keeps
+     * the start time, so the handshake still times out NETWORK_TIMEOUT_MS after the first.
+     * @param handshake The session after PUF_CON_phase() and PUF_SYN_phase()
+     * @param now_ms Current time in ms
+     * @return The session or NULL if the table is full
+    */
+    Session* emplace(const Session& handshake, uint32_t now_ms = 0);
+
+    /**
+     * Ends the pending handshake of a supplicant as failed. A connected session stays
+     * connected, any other is removed.
+     * @param remote_mac The (hashed) source MAC of the supplicant
+    */
+    void reject(const MAC& remote_mac);
+
+    /**
+     * Removes the session of a supplicant, if any
+     * @param remote_mac The (hashed) source MAC of the supplicant
+    */
+    void erase(const MAC& remote_mac);
+
+    /**
+     * Removes all sessions whose handshake has not completed within timeout_ms, a
+     * connected session only loses the handshake.
+     * With chains, connected sessions are checked against their flows from then on,
+     * every idle_ms. A session is removed together with its flow once the flow has
+     * seen no valid frame for idle_ms, and alone once its flow has ended, e.g.
+     * because the device moved on to its next identity.
+     * @param now_ms Current time in ms
+     * @param timeout_ms Maximum duration of a handshake
+     * @param chains The flows of the connected sessions, NULL to keep connected
+     *               sessions. Must be the caller's to change, see ChainTable
+     * @param idle_ms Time a flow may be idle
+     * @return The number of removed sessions
+    */
+    size_t expire(uint32_t now_ms, uint32_t timeout_ms, ChainTable *chains = NULL,
+                  uint32_t idle_ms = SESSION_IDLE_MS);
+
+    size_t size() const;
+    size_t capacity() const;
+};
+
+
+/**
+ * The phases of a handshake as run by the Authenticator. They keep all state in the
+ * session and their arguments, so any thread may run them on a session it holds.
+*/
+
+/**
+ * Queries the supplicant of a PUF_CON. Takes its base MAC, its public key A, the
+ * precomputed table of A if the server caches one and the commitment T into the
+ * session.
+ * @param s The session
+ * @param puf_con The received PUF_CON
+ * @param as The server, must be thread-safe if several threads run handshakes
+ * @return 0 on success, 1 if the supplicant is unknown or denied
+*/
+int PUF_CON_phase(Session &s, const PUF_CON &puf_con, AuthenticationServer &as);
+
+/**
+ * Draws the challenge d and the secret c, takes d and k = (T*c).x into the session
+ * and builds the PUF_SYN. The PUF_SYN is not sent.
+ * @param s The session after PUF_CON_phase()
+ * @param switch_mac Source MAC of the PUF_SYN
+ * @param statics PUFStatics of the calling thread
+ * @param puf_syn Receives the PUF_SYN
+ * @return 0 on success
+*/
+int PUF_SYN_phase(Session &s, const MAC &switch_mac, PUFStatics &statics, PUF_SYN &puf_syn);
+
+/**
+ * Checks S == A*d + T, all values are public
+ * @param s The session after PUF_SYN_phase()
+ * @param puf_syn_ack The received PUF_SYN_ACK
+ * @return True if access is granted
+*/
+bool PUF_ACK_phase(const Session &s, const PUF_SYN_ACK &puf_syn_ack);
+
+/**
+ * @return The 4 bytes of the shared secret k that key the hash chain of the flow
+*/
+const uint8_t* chain_key(const Session &s);
+
+
+};  // namespace puf
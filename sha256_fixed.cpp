@@ -0,0 +1,465 @@
+#include "sha256_fixed.h"
+
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SHA256_X86
+#include <immintrin.h>
+#include <cpuid.h>
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#define SHA256_ARM
+#include <arm_neon.h>
+#endif
+
+
+namespace puf {
+
+
+namespace {
+
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+
+inline uint32_t load_be32(const uint8_t *p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+
+inline void store_be32(uint8_t *p, uint32_t x) {
+    p[0] = x >> 24;
+    p[1] = x >> 16;
+    p[2] = x >> 8;
+    p[3] = x;
+}
+
+
+#define ROTR(x, n)      (((x) >> (n)) | ((x) << (32 - (n))))
+
+
+/**
+ * The 64 rounds of SHA-256 on one block per lane, adding the result to the state.
+ * V is either uint32_t or a GCC vector of 32 bit words, so the same code yields
+ * the scalar and the SIMD kernels.
+*/
+template<typename V>
+inline __attribute__((always_inline)) void rounds(V *state, V *w) {
+    V a = state[0], b = state[1], c = state[2], d = state[3];
+    V e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for(unsigned t=0; t<64; ++t) {
+        if(t >= 16) {
+            const V w15 = w[(t-15) & 15], w2 = w[(t-2) & 15];
+            w[t & 15] += (ROTR(w15, 7) ^ ROTR(w15, 18) ^ (w15 >> 3)) + w[(t-7) & 15] +
+                         (ROTR(w2, 17) ^ ROTR(w2, 19) ^ (w2 >> 10));
+        }
+
+        const V t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + K[t] + w[t & 15];
+        const V t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+
+/**
+ * SHA-256 of L inputs of LEN < 56 bytes, i.e. a single block each. Lane i of
+ * every vector belongs to input i.
+*/
+template<typename V, unsigned L, size_t LEN>
+inline __attribute__((always_inline)) void compress_lanes(const uint8_t *in, uint8_t *out) {
+    static_assert(LEN < 56, "Input must fit into one block");
+    uint32_t lane[16][L];
+    uint8_t block[64];
+    V w[16], state[8];
+
+    // Padded block of every input, transposed into one vector per word
+    memset(block, 0, sizeof(block));
+    block[LEN] = 0x80;
+    store_be32(block + 60, LEN * 8);
+    for(unsigned i=0; i<L; ++i) {
+        memcpy(block, in + i*LEN, LEN);
+        for(unsigned j=0; j<16; ++j) {
+            lane[j][i] = load_be32(block + 4*j);
+        }
+    }
+    for(unsigned j=0; j<16; ++j) {
+        memcpy(&w[j], lane[j], sizeof(V));
+    }
+    for(unsigned j=0; j<8; ++j) {
+        state[j] = V{} + H0[j];
+    }
+
+    rounds<V>(state, w);
+
+    for(unsigned j=0; j<8; ++j) {
+        memcpy(lane[j], &state[j], sizeof(V));
+        for(unsigned i=0; i<L; ++i) {
+            store_be32(out + i*32 + 4*j, lane[j][i]);
+        }
+    }
+}
+
+
+/**
+ * Hashes L MACs steps times each as MAC::hash() does. Between the steps the first 6
+ * bytes of the digests stay in the vectors as the message of the next block, so
+ * the MACs are transposed only once.
+*/
+template<typename V, unsigned L>
+inline __attribute__((always_inline)) void iterate_lanes(uint8_t *macs, uint32_t steps) {
+    uint32_t lane[2][L];
+    V m0, m1, w[16], state[8];
+
+    for(unsigned i=0; i<L; ++i) {
+        lane[0][i] = load_be32(macs + 6*i);
+        lane[1][i] = (static_cast<uint32_t>(macs[6*i+4]) << 24) | (static_cast<uint32_t>(macs[6*i+5]) << 16);
+    }
+    memcpy(&m0, lane[0], sizeof(V));
+    memcpy(&m1, lane[1], sizeof(V));
+
+    for(uint32_t s=0; s<steps; ++s) {
+        w[0] = m0;
+        w[1] = m1 | 0x8000;
+        for(unsigned j=2; j<15; ++j) {
+            w[j] = V{};
+        }
+        w[15] = V{} + 6 * 8;
+        for(unsigned j=0; j<8; ++j) {
+            state[j] = V{} + H0[j];
+        }
+
+        rounds<V>(state, w);
+
+        m0 = state[0];
+        m1 = state[1] & 0xffff0000;
+    }
+
+    memcpy(lane[0], &m0, sizeof(V));
+    memcpy(lane[1], &m1, sizeof(V));
+    for(unsigned i=0; i<L; ++i) {
+        store_be32(macs + 6*i, lane[0][i]);
+        macs[6*i+4] = lane[1][i] >> 24;
+        macs[6*i+5] = lane[1][i] >> 16;
+    }
+}
+
+
+/*
+ * Single block kernels. The message words w already contain the padding and
+ * the length, the digest is written big endian to out.
+*/
+
+void block_portable(const uint32_t *w_, uint8_t *out) {
+    uint32_t state[8], w[16];
+
+    memcpy(state, H0, sizeof(state));
+    memcpy(w, w_, sizeof(w));
+    rounds<uint32_t>(state, w);
+
+    for(unsigned j=0; j<8; ++j) {
+        store_be32(out + 4*j, state[j]);
+    }
+}
+
+
+#ifdef SHA256_X86
+
+/* Based on the SHA extensions reference flow by Intel */
+__attribute__((target("sha,sse4.1")))
+void block_shani(const uint32_t *w, uint8_t *out) {
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i state0, state1, msg, tmp;
+    __m128i msg0, msg1, msg2, msg3;
+
+    // ABEF and CDGH
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(H0)), 0xb1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(H0+4)), 0x1b);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+    const __m128i abef = state0, cdgh = state1;
+
+    msg0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w));
+    msg1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w+4));
+    msg2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w+8));
+    msg3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w+12));
+
+#define SHANI_ROUNDS(m, i) \
+    msg = _mm_add_epi32(m, _mm_loadu_si128(reinterpret_cast<const __m128i*>(K + 4*(i)))); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e))
+
+#define SHANI_SCHEDULE(m0, m1, m2, m3) \
+    m0 = _mm_sha256msg1_epu32(m0, m1); \
+    m0 = _mm_add_epi32(m0, _mm_alignr_epi8(m3, m2, 4)); \
+    m0 = _mm_sha256msg2_epu32(m0, m3)
+
+    SHANI_ROUNDS(msg0, 0);
+    SHANI_ROUNDS(msg1, 1);
+    SHANI_ROUNDS(msg2, 2);
+    SHANI_ROUNDS(msg3, 3);
+    for(int i=4; i<16; i+=4) {
+        SHANI_SCHEDULE(msg0, msg1, msg2, msg3);
+        SHANI_ROUNDS(msg0, i);
+        SHANI_SCHEDULE(msg1, msg2, msg3, msg0);
+        SHANI_ROUNDS(msg1, i+1);
+        SHANI_SCHEDULE(msg2, msg3, msg0, msg1);
+        SHANI_ROUNDS(msg2, i+2);
+        SHANI_SCHEDULE(msg3, msg0, msg1, msg2);
+        SHANI_ROUNDS(msg3, i+3);
+    }
+
+#undef SHANI_ROUNDS
+#undef SHANI_SCHEDULE
+
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+
+    // Back to ABCD and EFGH, big endian
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(state0, bswap));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out+16), _mm_shuffle_epi8(state1, bswap));
+}
+
+
+bool has_shani() {
+    unsigned eax, ebx, ecx, edx;
+    if( !__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) ) {
+        return false;
+    }
+    if( !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) ) {
+        return false;
+    }
+    return (ebx & bit_SHA) != 0;
+}
+
+#endif
+
+
+#ifdef SHA256_ARM
+
+void block_armv8(const uint32_t *w, uint8_t *out) {
+    uint32x4_t state0 = vld1q_u32(H0), state1 = vld1q_u32(H0+4);
+    uint32x4_t msg[4], tmp, abcd;
+
+    for(int i=0; i<4; ++i) {
+        msg[i] = vld1q_u32(w + 4*i);
+    }
+
+    for(int i=0; i<16; ++i) {
+        uint32x4_t &m = msg[i & 3];
+        if(i >= 4) {
+            m = vsha256su1q_u32(vsha256su0q_u32(m, msg[(i+1) & 3]), msg[(i+2) & 3], msg[(i+3) & 3]);
+        }
+        tmp = vaddq_u32(m, vld1q_u32(K + 4*i));
+        abcd = state0;
+        state0 = vsha256hq_u32(state0, state1, tmp);
+        state1 = vsha256h2q_u32(state1, abcd, tmp);
+    }
+
+    state0 = vaddq_u32(state0, vld1q_u32(H0));
+    state1 = vaddq_u32(state1, vld1q_u32(H0+4));
+    vst1q_u8(out, vrev32q_u8(vreinterpretq_u8_u32(state0)));
+    vst1q_u8(out+16, vrev32q_u8(vreinterpretq_u8_u32(state1)));
+}
+
+#endif
+
+
+void (*select_block(bool extensions))(const uint32_t*, uint8_t*) {
+    if( !extensions ) {
+        return block_portable;
+    }
+#if defined(SHA256_ARM)
+    return block_armv8;
+#else
+#if defined(SHA256_X86)
+    if( has_shani() ) {
+        return block_shani;
+    }
+#endif
+    return block_portable;
+#endif
+}
+
+
+void (*block)(const uint32_t *w, uint8_t *out) = select_block(true);
+
+
+void chain_scalar(const uint8_t *in, uint8_t *out) {
+    sha256_chain(in, out);
+}
+
+
+void iterate_scalar(uint8_t *mac, uint32_t steps) {
+    uint8_t out[32];
+    for(uint32_t s=0; s<steps; ++s) {
+        sha256_mac(mac, out);
+        memcpy(mac, out, 6);
+    }
+}
+
+
+#ifdef SHA256_X86
+
+typedef uint32_t v8u32 __attribute__((vector_size(32)));
+typedef uint32_t v16u32 __attribute__((vector_size(64)));
+
+__attribute__((target("avx2")))
+void chain_avx2(const uint8_t *in, uint8_t *out) {
+    compress_lanes<v8u32, 8, SHA256_CHAIN_LEN>(in, out);
+}
+
+__attribute__((target("avx512f")))
+void chain_avx512(const uint8_t *in, uint8_t *out) {
+    compress_lanes<v16u32, 16, SHA256_CHAIN_LEN>(in, out);
+}
+
+__attribute__((target("avx2")))
+void iterate_avx2(uint8_t *macs, uint32_t steps) {
+    iterate_lanes<v8u32, 8>(macs, steps);
+}
+
+__attribute__((target("avx512f")))
+void iterate_avx512(uint8_t *macs, uint32_t steps) {
+    iterate_lanes<v16u32, 16>(macs, steps);
+}
+
+#endif
+
+
+typedef struct Kernel {
+    unsigned lanes;
+    void (*fn)(const uint8_t *in, uint8_t *out);
+    void (*iterate)(uint8_t *macs, uint32_t steps);
+} Kernel;
+
+
+Kernel detect(unsigned max_lanes) {
+#ifdef SHA256_X86
+    __builtin_cpu_init();
+    if( max_lanes >= 16 && __builtin_cpu_supports("avx512f") ) {
+        return {16, chain_avx512, iterate_avx512};
+    }
+    // One block with the SHA extensions is faster than 8 lanes
+    if( max_lanes >= 8 && __builtin_cpu_supports("avx2") && block != block_shani ) {
+        return {8, chain_avx2, iterate_avx2};
+    }
+#endif
+    (void) max_lanes;
+    return {1, chain_scalar, iterate_scalar};
+}
+
+
+Kernel kernel = detect(~0u);
+
+
+};  // namespace
+
+
+void sha256_mac(const uint8_t *in, uint8_t *out) {
+    uint32_t w[16] = {0};
+
+    w[0] = load_be32(in);
+    w[1] = (static_cast<uint32_t>(in[4]) << 24) | (static_cast<uint32_t>(in[5]) << 16) | 0x8000;
+    w[15] = 6 * 8;
+    block(w, out);
+}
+
+
+void sha256_chain(const uint8_t *in, uint8_t *out) {
+    uint32_t w[16] = {0};
+
+    for(unsigned j=0; j<SHA256_CHAIN_LEN/4; ++j) {
+        w[j] = load_be32(in + 4*j);
+    }
+    w[SHA256_CHAIN_LEN/4] = 0x80000000;
+    w[15] = SHA256_CHAIN_LEN * 8;
+    block(w, out);
+}
+
+
+void sha256_chain_many(const uint8_t *in, uint8_t *out, size_t n) {
+    const Kernel k = kernel;
+
+    for(; n >= k.lanes; n -= k.lanes) {
+        k.fn(in, out);
+        in += k.lanes * SHA256_CHAIN_LEN;
+        out += k.lanes * 32;
+    }
+
+    // Fill up a last vector unless most of its lanes would be wasted
+    if( n > 0 && 2*n >= k.lanes ) {
+        uint8_t in_buf[16 * SHA256_CHAIN_LEN];
+        uint8_t out_buf[16 * 32];
+        memset(in_buf, 0, sizeof(in_buf));
+        memcpy(in_buf, in, n * SHA256_CHAIN_LEN);
+        k.fn(in_buf, out_buf);
+        memcpy(out, out_buf, n * 32);
+        return;
+    }
+
+    for(; n > 0; --n) {
+        chain_scalar(in, out);
+        in += SHA256_CHAIN_LEN;
+        out += 32;
+    }
+}
+
+
+void sha256_mac_iterate(uint8_t *macs, size_t n, uint32_t steps) {
+    const Kernel k = kernel;
+
+    for(; n >= k.lanes; n -= k.lanes) {
+        k.iterate(macs, steps);
+        macs += k.lanes * 6;
+    }
+
+    if( n > 0 && 2*n >= k.lanes ) {
+        uint8_t buf[16 * 6];
+        memset(buf, 0, sizeof(buf));
+        memcpy(buf, macs, n * 6);
+        k.iterate(buf, steps);
+        memcpy(macs, buf, n * 6);
+        return;
+    }
+
+    for(; n > 0; --n) {
+        iterate_scalar(macs, steps);
+        macs += 6;
+    }
+}
+
+
+unsigned sha256_lanes() {
+    return kernel.lanes;
+}
+
+
+void sha256_select(unsigned max_lanes) {
+    block = select_block(max_lanes != 1);
+    kernel = detect(max_lanes == 0 ? ~0u : max_lanes);
+}
+
+
+};  // namespace puf
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace puf {
+
+
+/* Length of a hash chain input: last hash (or MAC) followed by 4 bytes of k */
+#define SHA256_CHAIN_LEN    36
+
+
+/**
+ * SHA-256 of a MAC address, i.e. of 6 bytes. Uses the SHA extensions of x86 or
+ * ARMv8 if available.
+ * @param in 6 bytes
+ * @param out Digest of 32 bytes
+*/
+void sha256_mac(const uint8_t *in, uint8_t *out);
+
+/**
+ * SHA-256 of a hash chain input of SHA256_CHAIN_LEN bytes. Uses the SHA extensions
+ * of x86 or ARMv8 if available.
+ * @param in SHA256_CHAIN_LEN bytes
+ * @param out Digest of 32 bytes
+*/
+void sha256_chain(const uint8_t *in, uint8_t *out);
+
+/**
+ * Hashes n independent inputs of SHA256_CHAIN_LEN bytes each. Runs several inputs
+ * per instruction with AVX-512 (16 lanes) or AVX2 (8 lanes) if the CPU supports it,
+ * selected at runtime, and one by one with sha256_chain() otherwise. AVX2 is not
+ * used on CPUs with SHA extensions, which are faster.
+ *
+ * @param in n consecutive inputs of SHA256_CHAIN_LEN bytes
+ * @param out n consecutive digests of 32 bytes
+ * @param n Number of inputs
+*/
+void sha256_chain_many(const uint8_t *in, uint8_t *out, size_t n);
+
+/**
+ * Hashes n independent MACs steps times each, keeping the first 6 bytes of every
+ * digest as MAC::hash() does. Uses the same lanes as sha256_chain_many() and keeps
+ * the MACs in the vectors between the steps.
+ * @param macs n consecutive MACs of 6 bytes, replaced by the results
+ * @param n Number of MACs
+ * @param steps Number of hashes per MAC
+*/
+void sha256_mac_iterate(uint8_t *macs, size_t n, uint32_t steps);
+
+/**
+ * @return Number of inputs sha256_chain_many() and sha256_mac_iterate() hash at once
+*/
+unsigned sha256_lanes();
+
+/**
+ * Restricts sha256_chain_many() and sha256_mac_iterate() to at most max_lanes
+ * lanes, e.g. to compare the kernels. 1 selects the portable code for all
+ * functions, 0 restores the runtime detection.
+*/
+void sha256_select(unsigned max_lanes);
+
+
+};  // namespace puf
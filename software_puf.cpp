@@ -0,0 +1,46 @@
+#include "software_puf.h"
+
+#include <mbedtls/sha256.h>
+
+
+namespace puf {
+
+
+SoftwarePUF::SoftwarePUF(uint64_t seed) {
+    for(size_t i=0; i<sizeof(key); ++i) {
+        key[i] = static_cast<uint8_t>(seed >> (8 * i));
+    }
+}
+
+
+MAC SoftwarePUF::derive(uint8_t domain, const MAC &input) const {
+    uint8_t buf[sizeof(key) + 1 + sizeof(input.bytes)];
+    uint8_t digest[32];
+    MAC out;
+
+    memcpy(buf, key, sizeof(key));
+    buf[sizeof(key)] = domain;
+    memcpy(buf + sizeof(key) + 1, input.bytes, sizeof(input.bytes));
+#if MBEDTLS_VERSION_MAJOR >= 3
+    mbedtls_sha256(buf, sizeof(buf), digest, 0);
+#else
+    mbedtls_sha256_ret(buf, sizeof(buf), digest, 0);
+#endif
+    memcpy(out.bytes, digest, sizeof(out.bytes));
+    return out;
+}
+
+
+MAC SoftwarePUF::puf_to_mac() const {
+    MAC mac = derive(0, MAC{});
+    mac.bytes[0] = (mac.bytes[0] & 0xfc) | 0x02;
+    return mac;
+}
+
+
+MAC SoftwarePUF::get_puf_response(const puf::MAC& puf_challenge) const {
+    return derive(1, puf_challenge);
+}
+
+
+};  // namespace puf
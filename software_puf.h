@@ -0,0 +1,33 @@
+#pragma once
+
+#include "platform.h"
+
+namespace puf {
+
+
+/**
+ * Deterministic stand-in for an SRAM PUF, e.g. to simulate many devices in tests
+ * and benchmarks. MAC and responses are derived from the seed by SHA-256, so every
+ * seed behaves like a distinct, perfectly stable device.
+*/
+class SoftwarePUF : public PUF {
+private:
+    uint8_t key[8];
+
+    MAC derive(uint8_t domain, const MAC &input) const;
+
+public:
+    /**
+     * @param seed Identity of the simulated device
+    */
+    SoftwarePUF(uint64_t seed);
+
+    /**
+     * @return A locally administered unicast MAC unique to the seed
+    */
+    MAC puf_to_mac() const override;
+    MAC get_puf_response(const puf::MAC& puf_challenge) const override;
+};
+
+
+};  // namespace puf
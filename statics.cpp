@@ -1,23 +1,38 @@
 #include "statics.h"
 #include "global_defines.h"
 
+#include <string.h>
+
+#include <atomic>
+
 
 namespace puf {
 
 const unsigned char PS[] = "puf-acs-esp";
 
 
+/* Numbers the instances, so that no two DRBGs share their personalization */
+static std::atomic<uint64_t> instances(0);
+
+
 PUFStatics::PUFStatics() {
+    unsigned char personalization[sizeof(PS) + sizeof(uint64_t)];
+    const uint64_t n = instances.fetch_add(1);
+    memcpy(personalization, PS, sizeof(PS));
+    memcpy(personalization + sizeof(PS), &n, sizeof(n));
+
     mbedtls_ecp_group_init(&group);
     mbedtls_ecp_group_load(&group, ELLIPTIC_CURVE);
     mbedtls_entropy_init(&entropy);
     mbedtls_ctr_drbg_init(&ctr_drbg);
-    mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, PS, sizeof(PS));
+    mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, personalization, sizeof(personalization));
+    ecp_arith_ = new ECP_Arith(group);
     initialised = true;
 }
 
 
 PUFStatics::~PUFStatics() {
+    delete ecp_arith_;
     mbedtls_ecp_group_free(&group);
     mbedtls_entropy_free(&entropy);
     mbedtls_ctr_drbg_free(&ctr_drbg);
@@ -25,11 +40,23 @@ PUFStatics::~PUFStatics() {
 
 
 PUFStatics& PUFStatics::instance() {
-    static PUFStatics inst;
+    static thread_local PUFStatics inst;
     return inst;
 }
 
 
+const mbedtls_ecp_group& PUFStatics::curve() {
+    // Left to the OS at exit, tables may still refer to it from static destructors
+    static mbedtls_ecp_group *grp = []() {
+        mbedtls_ecp_group *g = new mbedtls_ecp_group;
+        mbedtls_ecp_group_init(g);
+        mbedtls_ecp_group_load(g, ELLIPTIC_CURVE);
+        return g;
+    }();
+    return *grp;
+}
+
+
 mbedtls_ecp_group& PUFStatics::ecp_group() {
     return group;
 }
@@ -39,4 +66,9 @@ mbedtls_ctr_drbg_context& PUFStatics::ctr_drbg_context() {
     return ctr_drbg;
 }
 
+
+ECP_Arith& PUFStatics::ecp_arith() {
+    return *ecp_arith_;
+}
+
 };  // namespace puf
\ No newline at end of file
@@ -5,15 +5,26 @@
 #include <mbedtls/ecp.h>
 
 #include "math.h"
+#include "ecp_arith.h"
 
 namespace puf {
 
+/**
+ * Curve, random number generator and arithmetic scratch of the calling thread.
+ * instance() returns one object per thread, so scalar multiplications, which
+ * cache in the group and draw from the DRBG, run on all threads without a lock.
+ * Every DRBG is seeded from its own entropy context and reseeds on its own.
+ *
+ * Objects that outlive a thread, e.g. the tables of a KeyTableCache, refer to
+ * curve() instead.
+*/
 class PUFStatics {
 private:
     bool initialised;
     mbedtls_ecp_group group;
     mbedtls_entropy_context entropy;
     mbedtls_ctr_drbg_context ctr_drbg;
+    ECP_Arith *ecp_arith_;
 
     PUFStatics();
     PUFStatics(const PUFStatics&) = delete;
@@ -22,10 +33,20 @@ private:
 
 public:
 
+    /**
+     * @return The instance of the calling thread
+    */
     static PUFStatics& instance();
 
+    /**
+     * Group shared by all threads and never destroyed. Read-only: must not be passed
+     * to mbedtls_ecp_mul() or mbedtls_ecp_muladd(), which cache in the group.
+    */
+    static const mbedtls_ecp_group& curve();
+
     mbedtls_ecp_group& ecp_group();
     mbedtls_ctr_drbg_context& ctr_drbg_context();
+    ECP_Arith& ecp_arith();
 };
 
 };  // namespace puf
\ No newline at end of file
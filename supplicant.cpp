@@ -2,7 +2,7 @@
 #include "statics.h"
 #include "errors.h"
 #include <time.h>
-#include <mbedtls/sha256.h>
+#include "sha256_fixed.h"
 
 namespace puf {
 
@@ -15,17 +15,18 @@ Supplicant::Supplicant(Network &net_, PUF &puf_) :
     net(net_), 
     sram_puf(puf_),
     G(PUFStatics::instance().ecp_group().G) {
+    memset(hk_mac, 0, sizeof(hk_mac));
 }
 
 
 // Init hardwarespecific modules
-void Supplicant::init() {
+void Supplicant::init(uint32_t position) {
     net.init();
     mac = sram_puf.puf_to_mac();
     state = INITIALISED;
 
     // ToDo: Use Non-Volatile Storage to know how many times the mach must be hashed
-    mac.hash(1);
+    mac.hash(position);
 }
 
 
@@ -176,24 +177,22 @@ void Supplicant::connect(int attempts) {
 }
 
 
-void Supplicant::transmit(uint8_t *buf, size_t bufSize, bool initial_frame) {
-    static uint8_t hk_mac[32];
-    static uint8_t concat_buf[36];
-    static VLAN_Payload p;
-    static PUF_Performance pp;
+void Supplicant::next_frame(bool initial_frame) {
+    uint8_t concat_buf[SHA256_CHAIN_LEN];
+    VLAN_Payload p;
 
     size_t k_offset = 0;
 
     if(initial_frame) {
         memset(hk_mac, 0, sizeof(hk_mac));
-        memset(pp.binary(), 0, pp.header_len());
 
         // Build static frame on first send
         pp.src_mac = mac;
         pp.dst_mac = switch_mac;
         pp.calc();
 
-        // Copy MAC into concatenation buffer
+        // Copy MAC into concatenation buffer, the remainder is zero
+        memset(concat_buf, 0, sizeof(concat_buf));
         k_offset = sizeof(mac.bytes);
         memcpy(concat_buf, mac.bytes, k_offset);
     } else {
@@ -205,22 +204,79 @@ void Supplicant::transmit(uint8_t *buf, size_t bufSize, bool initial_frame) {
     // Concatenate 4 digits of k to concatenation buffer
     memcpy(concat_buf+k_offset, (void*)k.private_p, 4);
 
-    if( mbedtls_sha256(concat_buf, sizeof(concat_buf), hk_mac, 0) != ESP_OK) {
-        return;
-    }
-
-    // Set user data
-    if(bufSize > 0 && buf != NULL) {
-        memcpy(static_cast<void*>(pp.binary()+22), buf, bufSize );  // ToDo: Dynamic header length
-    }
+    sha256_chain(concat_buf, hk_mac);
 
     // Set VLAN tags
     p.load1 = *(reinterpret_cast<uint16_t*>(hk_mac));
     p.load2 = *(reinterpret_cast<uint16_t*>(hk_mac+30));
     pp.set_payload(p);
+}
+
+
+void Supplicant::transmit(uint8_t *buf, size_t bufSize, bool initial_frame) {
+    if(buf == NULL) {
+        bufSize = 0;
+    }
+    if(PUF_PERFORMANCE_HEADROOM + bufSize > ETHER_FRAME_LEN) {
+        throw PacketException("PUF_Performance: Data too large");
+    }
+
+    next_frame(initial_frame);
+
+    // Short frames are padded in pp, longer ones are sent without copying the data
+    if(PUF_PERFORMANCE_HEADROOM + bufSize < ETHER_MIN_FRAME_LEN) {
+        pp.set_data(buf, bufSize);
+        net.send(pp.binary(), pp.len());
+    } else {
+        net.send_gather(pp.binary(), PUF_PERFORMANCE_HEADROOM, buf, bufSize);
+    }
+}
+
 
-    net.send(pp.binary(), pp.header_len());
+void Supplicant::transmit_in_place(uint8_t *frame, size_t frame_size, size_t data_len, bool initial_frame) {
+    size_t len = PUF_PERFORMANCE_HEADROOM + data_len;
+
+    if(frame == NULL || len > ETHER_FRAME_LEN || len > frame_size) {
+        throw PacketException("PUF_Performance: Data does not fit into frame");
+    }
+    if(len < ETHER_MIN_FRAME_LEN) {
+        if(frame_size < ETHER_MIN_FRAME_LEN) {
+            throw PacketException("PUF_Performance: Frame too small for padding");
+        }
+        memset(frame + len, 0, ETHER_MIN_FRAME_LEN - len);
+        len = ETHER_MIN_FRAME_LEN;
+    }
+
+    next_frame(initial_frame);
+
+    // Header goes into the reserved headroom, the data stays where it is
+    memcpy(frame, pp.binary(), PUF_PERFORMANCE_HEADROOM);
+    net.send(frame, len);
+}
+
+
+void Supplicant::transmit_burst(Frame *frames, size_t n, bool initial_frame) {
+    size_t i;
+
+    for(i=0; i<n; ++i) {
+        const size_t min_len = frames[i].len < ETHER_MIN_FRAME_LEN ? ETHER_MIN_FRAME_LEN : frames[i].len;
+        if(frames[i].buf == NULL || frames[i].len < PUF_PERFORMANCE_HEADROOM ||
+           frames[i].len > ETHER_FRAME_LEN || min_len > frames[i].size) {
+            throw PacketException("PUF_Performance: Data does not fit into frame");
+        }
+    }
+
+    for(i=0; i<n; ++i) {
+        if(frames[i].len < ETHER_MIN_FRAME_LEN) {
+            memset(frames[i].buf + frames[i].len, 0, ETHER_MIN_FRAME_LEN - frames[i].len);
+            frames[i].len = ETHER_MIN_FRAME_LEN;
+        }
+
+        next_frame(initial_frame && i == 0);
+        memcpy(frames[i].buf, pp.binary(), PUF_PERFORMANCE_HEADROOM);
+    }
 
+    net.send_batch(frames, n);
 }
 
 
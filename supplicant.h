@@ -24,7 +24,11 @@ private:
     PUF &sram_puf;
     ECP_Point G;
 
+    uint8_t hk_mac[32];         // Last value of the hash chain
+    PUF_Performance pp;         // Data frame, built on the initial frame
+
     int wait_for_AU_ok();
+    void next_frame(bool initial_frame);
 
 
     // Three phases
@@ -52,8 +56,9 @@ public:
     /**
      * Initialises the supplicant by extracting the PUF and initialising the network.
      * Recalculates MAC address each time when called.
+     * @param position Position of the MAC in the hash chain of the base MAC. Defaults to 1
     */
-    void init();
+    void init(uint32_t position = 1);
 
     /**
      * Connect to the Authenticator by performing the three way handshake
@@ -72,7 +77,35 @@ public:
     */
     void sign_up();     // Thanks C++ for making register a keyword
 
+    /**
+     * Sends data in a PUF_Performance frame tagged with the next value of the hash chain.
+     * Data longer than the padding is passed to Network::send_gather() without copying.
+     * @param buf The data
+     * @param bufSize Length of the data
+     * @param initial_frame Starts a new hash chain
+    */
     void transmit(uint8_t *buf, size_t bufSize, bool initial_frame=false);
+
+    /**
+     * Sends data that the caller placed behind PUF_PERFORMANCE_HEADROOM reserved
+     * bytes. The header is written into the headroom and the frame is sent in place.
+     * @param frame The buffer, data starts at frame + PUF_PERFORMANCE_HEADROOM
+     * @param frame_size Size of the buffer, at least ETHER_MIN_FRAME_LEN for short data
+     * @param data_len Length of the data
+     * @param initial_frame Starts a new hash chain
+    */
+    void transmit_in_place(uint8_t *frame, size_t frame_size, size_t data_len, bool initial_frame=false);
+
+    /**
+     * Sends a burst of frames in place as transmit_in_place() does, with one call of
+     * Network::send_batch().
+     * @param frames The frames. Data starts at buf + PUF_PERFORMANCE_HEADROOM, len is
+     *               PUF_PERFORMANCE_HEADROOM plus the length of the data and is
+     *               raised to ETHER_MIN_FRAME_LEN for short data
+     * @param n Number of frames
+     * @param initial_frame The first frame starts a new hash chain
+    */
+    void transmit_burst(Frame *frames, size_t n, bool initial_frame=false);
 };
 
 
@@ -0,0 +1,264 @@
+#include "wal.h"
+
+#ifdef __linux__
+
+#include "errors.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <chrono>
+
+
+namespace puf {
+
+
+typedef struct __attribute__((__packed__)) WalHeader {
+    char magic[8];
+    uint64_t seq;
+} WalHeader;
+
+static const char WAL_MAGIC[8] = {'P', 'U', 'F', 'W', 'A', 'L', '0', '2'};
+
+
+/* FNV-1a, detects records torn by a crash */
+static uint64_t checksum(const WalRecord &rec) {
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(&rec);
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for(size_t i=0; i<offsetof(WalRecord, check); ++i) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+
+static bool write_all(int fd, const uint8_t *buf, size_t n) {
+    while(n > 0) {
+        ssize_t w = write(fd, buf, n);
+        if(w < 0) {
+            if(errno == EINTR) continue;
+            return false;
+        }
+        buf += w;
+        n -= w;
+    }
+    return true;
+}
+
+
+WriteAheadLog::WriteAheadLog(const std::string &path)
+    : path(path), fd{-1, -1}, seq{0, 0}, current(0), next_lsn(1), durable_lsn(0), lost_lsn(0), flushing(false), bytes(0),
+      running(false) { }
+
+
+WriteAheadLog::~WriteAheadLog() {
+    stop();
+    {
+        std::unique_lock<std::mutex> l(lock);
+        try {
+            flush(l);
+        } catch(const Exception &e) {
+            puts(e.what());
+        }
+    }
+    for(int i=0; i<2; ++i) {
+        if(fd[i] >= 0) {
+            close(fd[i]);
+        }
+    }
+}
+
+
+size_t WriteAheadLog::open(std::function<void(const WalRecord&)> apply) {
+    std::vector<uint8_t> data[2];
+    size_t n = 0;
+
+    for(int i=0; i<2; ++i) {
+        const std::string file = path + "." + std::to_string(i);
+        struct stat st;
+        fd[i] = ::open(file.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if( fd[i] < 0 || fstat(fd[i], &st) != 0 ) {
+            throw Exception("WAL: Could not open segment");
+        }
+
+        data[i].resize(st.st_size);
+        if( pread(fd[i], data[i].data(), data[i].size(), 0) != static_cast<ssize_t>(data[i].size()) ) {
+            throw Exception("WAL: Could not read segment");
+        }
+
+        const WalHeader *h = reinterpret_cast<const WalHeader*>(data[i].data());
+        seq[i] = data[i].size() >= sizeof(WalHeader) && memcmp(h->magic, WAL_MAGIC, sizeof(WAL_MAGIC)) == 0 ? h->seq : 0;
+    }
+
+    // Older segment first, the current one is the newer
+    current = seq[1] > seq[0] ? 1 : 0;
+    for(int s : {current ^ 1, current}) {
+        if(seq[s] == 0) continue;
+        for(size_t off = sizeof(WalHeader); off + sizeof(WalRecord) <= data[s].size(); off += sizeof(WalRecord)) {
+            WalRecord rec;
+            memcpy(&rec, &data[s][off], sizeof(rec));
+            if( rec.check != checksum(rec) ) break;
+            apply(rec);
+            n++;
+        }
+    }
+    bytes = data[current].size();
+    return n;
+}
+
+
+void WriteAheadLog::reset(int segment, uint64_t sequence) {
+    WalHeader h;
+    memcpy(h.magic, WAL_MAGIC, sizeof(WAL_MAGIC));
+    h.seq = sequence;
+
+    if( ftruncate(fd[segment], 0) != 0 ||
+        (sequence > 0 && !write_all(fd[segment], reinterpret_cast<const uint8_t*>(&h), sizeof(h))) ||
+        fdatasync(fd[segment]) != 0 ) {
+        throw Exception("WAL: Could not reset segment");
+    }
+    seq[segment] = sequence;
+}
+
+
+uint64_t WriteAheadLog::append(WalRecord &rec) {
+    std::lock_guard<std::mutex> l(lock);
+    if(lost_lsn != 0) {
+        throw Exception("WAL: Log failed, records were lost");
+    }
+    rec.lsn = next_lsn++;
+    rec.check = checksum(rec);
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(&rec);
+    pending.insert(pending.end(), p, p + sizeof(rec));
+    bytes += sizeof(rec);
+    if(bytes > WAL_CHECKPOINT_BYTES) {
+        wake.notify_one();
+    }
+    return rec.lsn;
+}
+
+
+void WriteAheadLog::flush(std::unique_lock<std::mutex> &l) {
+    while(flushing) {
+        flushed.wait(l);
+    }
+    if(lost_lsn != 0) {
+        throw Exception("WAL: Log failed, records were lost");
+    }
+    if( pending.empty() || fd[current] < 0 ) {
+        return;
+    }
+
+    // Leader: write everything appended so far, followers wait for the result
+    std::vector<uint8_t> batch;
+    batch.swap(pending);
+    const uint64_t last = next_lsn - 1;
+    const int f = fd[current];
+    flushing = true;
+
+    l.unlock();
+    const bool ok = write_all(f, batch.data(), batch.size()) && fdatasync(f) == 0;
+    l.lock();
+
+    flushing = false;
+    if(ok) {
+        durable_lsn = last;
+    } else {
+        // The segment may end in a torn record, which hides all later ones from
+        // replay, so everything not yet on disk is lost, including what followers
+        // appended meanwhile
+        lost_lsn = next_lsn - 1;
+        pending.clear();
+    }
+    flushed.notify_all();
+    if(!ok) {
+        throw Exception("WAL: Could not write segment");
+    }
+}
+
+
+void WriteAheadLog::commit(uint64_t lsn) {
+    std::unique_lock<std::mutex> l(lock);
+    while(durable_lsn < lsn) {
+        flush(l);
+    }
+}
+
+
+void WriteAheadLog::checkpoint(std::function<void()> sync_data) {
+    std::lock_guard<std::mutex> serial(checkpointing);
+    int old;
+    {
+        std::unique_lock<std::mutex> l(lock);
+
+        // The store still holds every change, write it back at least
+        if(lost_lsn != 0) {
+            l.unlock();
+            sync_data();
+            throw Exception("WAL: Log failed, records were lost");
+        }
+        flush(l);
+
+        // Records appended from now on go to the other segment
+        old = current;
+        reset(old ^ 1, seq[old] + 1);
+        current = old ^ 1;
+        bytes = sizeof(WalHeader);
+    }
+
+    sync_data();
+
+    std::lock_guard<std::mutex> l(lock);
+    reset(old, 0);
+}
+
+
+void WriteAheadLog::start(std::function<void()> sync_data, unsigned interval_ms) {
+    std::lock_guard<std::mutex> l(lock);
+    if(running) {
+        return;
+    }
+    running = true;
+    checkpointer = std::thread([this, sync_data, interval_ms]() {
+        std::unique_lock<std::mutex> l(lock);
+        while(running) {
+            wake.wait_for(l, std::chrono::milliseconds(interval_ms));
+            if(!running) break;
+            l.unlock();
+            try {
+                checkpoint(sync_data);
+            } catch(const Exception &e) {
+                puts(e.what());
+            }
+            l.lock();
+        }
+    });
+}
+
+
+void WriteAheadLog::stop() {
+    {
+        std::lock_guard<std::mutex> l(lock);
+        running = false;
+        wake.notify_one();
+    }
+    if( checkpointer.joinable() ) {
+        checkpointer.join();
+    }
+}
+
+
+size_t WriteAheadLog::size() {
+    std::lock_guard<std::mutex> l(lock);
+    return bytes;
+}
+
+
+};  // namespace puf
+
+#endif  // __linux__
@@ -0,0 +1,139 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "global_defines.h"
+
+namespace puf {
+
+
+enum wal_record_e : uint8_t {
+    WAL_STORE_E = 0x01,         // store() of a supplicant
+    WAL_COUNTER_E = 0x02        // New counter value and chain position after a query()
+};
+
+
+/**
+ * Record of a WriteAheadLog. Records hold the new state rather than a change, so
+ * replaying a record that already reached the store does no harm.
+*/
+typedef struct __attribute__((__packed__)) WalRecord {
+    uint64_t lsn;               // Log sequence number, set by append()
+    uint8_t type;               // wal_record_e
+    uint8_t hashed_mac[6];
+    uint8_t base_mac[6];        // WAL_STORE_E only
+    int32_t ctr;
+    uint8_t A_len;              // WAL_STORE_E only
+    uint8_t A[65];              // WAL_STORE_E only
+    uint32_t step;              // WAL_COUNTER_E only, position in the MAC chain
+    uint8_t mac[6];             // WAL_COUNTER_E only, current identity
+    uint64_t check;             // Checksum of the bytes above, set by append()
+} WalRecord;
+
+
+/**
+ * Append-only log of the changes of an AuthenticationServer, alternating between two
+ * segment files <path>.0 and <path>.1.
+ *
+ * commit() makes records durable. Threads committing at the same time share one
+ * write and fdatasync(): the first one flushes the records of all others, which wait.
+ * A checkpoint flushes the current segment, switches to the other one, lets the
+ * store write its data back and then empties the old segment, so appends continue
+ * while the store syncs. open() replays both segments, oldest first, and stops at
+ * a torn record.
+ *
+ * A failed write is final: the records that were not yet on disk are lost, commit()
+ * throws for each of them and append() refuses new ones until the log is opened
+ * again, so no change is reported durable that did not reach the disk.
+*/
+class WriteAheadLog {
+private:
+    std::string path;
+    int fd[2];
+    uint64_t seq[2];            // Sequence number of the segments, 0 if empty
+    int current;                // Segment appended to
+
+    std::mutex lock;
+    std::condition_variable flushed;
+    std::condition_variable wake;
+    std::vector<uint8_t> pending;       // Appended, not yet written
+    uint64_t next_lsn;
+    uint64_t durable_lsn;
+    uint64_t lost_lsn;          // Records after durable_lsn up to this one were lost, 0 if none
+    bool flushing;
+    size_t bytes;               // Size of the current segment including pending records
+
+    std::mutex checkpointing;   // Serializes checkpoint()
+    std::thread checkpointer;
+    bool running;
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    void flush(std::unique_lock<std::mutex> &l);
+    void reset(int segment, uint64_t sequence);
+
+public:
+    /**
+     * @param path Path of the segments without suffix
+    */
+    WriteAheadLog(const std::string &path);
+    ~WriteAheadLog();
+
+    /**
+     * Opens the segments and replays their records. Call checkpoint() afterwards
+     * and before appending, a torn record would hide later ones.
+     * @param apply Called for every intact record in order
+     * @return Number of replayed records
+     * @throws Exception if a segment cannot be opened
+    */
+    size_t open(std::function<void(const WalRecord&)> apply);
+
+    /**
+     * Queues a record. Sets its lsn and check.
+     * @return The lsn to pass to commit()
+     * @throws Exception if a write failed before
+    */
+    uint64_t append(WalRecord &rec);
+
+    /**
+     * Waits until all records up to lsn are on disk
+     * @throws Exception if the segment cannot be written, now or before, i.e. the
+     *         record is lost
+    */
+    void commit(uint64_t lsn);
+
+    /**
+     * Switches segments and drops the records of the old one once sync_data wrote
+     * the store to disk. After a failed write only sync_data runs.
+     * @param sync_data Writes the store to disk
+     * @throws Exception if a write failed, now or before
+    */
+    void checkpoint(std::function<void()> sync_data);
+
+    /**
+     * Starts a thread running checkpoint() every interval_ms and whenever the log
+     * exceeds WAL_CHECKPOINT_BYTES
+    */
+    void start(std::function<void()> sync_data, unsigned interval_ms = WAL_CHECKPOINT_MS);
+    void stop();
+
+    /**
+     * @return Size of the current segment in bytes
+    */
+    size_t size();
+};
+
+
+};  // namespace puf
+
+#endif  // __linux__